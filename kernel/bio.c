@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -19,73 +19,420 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "riscv.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "bstat.h"
 
-struct {
+// Buffers are kept in hash buckets by dev and blockno, each with
+// its own lock, so that lookups of different blocks do not
+// contend. A bucket's lock protects its list and its buffers'
+// refcnt and queue, and dev and blockno while refcnt is 0. A
+// buffer that nobody is using stays in its bucket, cached, until
+// it is recycled for another block, when it is taken out of its
+// bucket and put in the new block's. No process holds two bucket
+// locks at once.
+//
+// Buffers are allocated as the cache fills, up to 1/BUFMEM of
+// the memory free at boot, and only while more than a quarter of
+// that is still free. Each page of block data holds BPERPG
+// buffers' data; their headers are carved from pages of their own.
+//
+// Which buffer to recycle is chosen as by 2Q, so that a scan
+// through a large file does not push out the inode, bitmap and
+// directory blocks in use: a block read in goes on A1in, a FIFO
+// that further uses of it while there do not change; once A1in
+// holds more than a quarter of the buffers, its oldest block is
+// recycled, and remembered in A1out (bghost). A block read in
+// again while in A1out has been used over a longer stretch, and
+// goes on Am, an LRU list from which blocks are recycled only
+// while A1in is within its share. Buffers that hold no block are
+// on a free list, and in no bucket.
+//
+// Each list has its own lock, taken after a bucket's, and keeps
+// its buffers in the order they are to be recycled, in use or
+// not, so that a victim is found near its head. A buffer stays
+// on its list while in use; only bput() moves one, to the end of
+// Am.
+
+#define NBUCKET 61
+#define BHASH(dev, blockno) (((dev) * 31 + (blockno)) % NBUCKET)
+#define BPERPG  (PGSIZE / BSIZE)   // buffers' data per page
+#define NGHOST  512   // blocks remembered in A1out
+#define NGHASH  127
+#define GHASH(dev, blockno) (((dev) * 31 + (blockno)) % NGHASH)
+
+// buf.queue: the list it is on.
+#define BFREE   0     // holds no block
+#define BA1IN   1
+#define BAM     2
+#define NBQUEUE  3
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;   // through buf.next
+};
+
+struct bqueue {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;   // next to recycle; through buf.qnext
+  struct buf *tail;
+  int n;
+};
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+struct {
+  struct bucket bucket[NBUCKET];
+  struct bqueue queue[NBQUEUE];
+
+  // lock protects growing the cache.
+  struct spinlock lock;
+  int nbuf;           // buffers allocated
+  int maxbuf;         // most there may be
+  uint64 minfree;     // free pages below which not to grow
+  struct buf *hdr;    // unused headers left in the last header page
+  int nhdr;
 } bcache;
 
+// A1out: a ring of recently recycled A1in blocks,
+// hashed by dev and blockno to be found quickly.
+struct {
+  struct spinlock lock;
+  struct {
+    uint dev;         // 0 if the slot is empty
+    uint blockno;
+    int hnext;        // next slot in its hash chain, or -1
+  } id[NGHOST];
+  int hash[NGHASH];   // first slot of each chain, or -1
+  int next;           // slot to fill next
+} bghost;
+
+// Hit and miss counts, per CPU so that they need no lock.
+static struct bstat cpubstat[NCPU];
+
+static int bgrow(void);
+
 void
 binit(void)
 {
-  struct buf *b;
+  int i;
 
-  initlock(&bcache.lock, "bcache");
+  for(i = 0; i < NBUCKET; i++)
+    initlock(&bcache.bucket[i].lock, "bcache");
+  for(i = 0; i < NBQUEUE; i++)
+    initlock(&bcache.queue[i].lock, "bqueue");
+  initlock(&bcache.lock, "bgrow");
+  initlock(&bghost.lock, "bghost");
+  for(i = 0; i < NGHASH; i++)
+    bghost.hash[i] = -1;
+
+  bcache.maxbuf = kfreepages() / BUFMEM * BPERPG;
+  if(bcache.maxbuf < NBUF)
+    bcache.maxbuf = NBUF;
+  bcache.minfree = kfreepages() / BUFMEM / 4;
+  while(bcache.nbuf < NBUF)
+    if(bgrow() < 0)
+      panic("binit");
+}
+
+static struct bucket*
+bbucket(uint dev, uint blockno)
+{
+  return &bcache.bucket[BHASH(dev, blockno)];
+}
+
+// Put b at the end of queue q. Caller holds q->lock.
+static void
+qappend(struct bqueue *q, struct buf *b)
+{
+  b->qnext = 0;
+  b->qprev = q->tail;
+  if(q->tail)
+    q->tail->qnext = b;
+  else
+    q->head = b;
+  q->tail = b;
+  q->n++;
+}
+
+// Take b off queue q. Caller holds q->lock.
+static void
+qremove(struct bqueue *q, struct buf *b)
+{
+  if(b->qprev)
+    b->qprev->qnext = b->qnext;
+  else
+    q->head = b->qnext;
+  if(b->qnext)
+    b->qnext->qprev = b->qprev;
+  else
+    q->tail = b->qprev;
+  b->qnext = b->qprev = 0;
+  q->n--;
+}
+
+// Put b, which holds no block, on the free list.
+static void
+bfree(struct buf *b)
+{
+  struct bqueue *q = &bcache.queue[BFREE];
+
+  b->dev = 0;
+  b->queue = BFREE;
+  acquire(&q->lock);
+  qappend(q, b);
+  release(&q->lock);
+}
+
+// Add a page of free buffers to the cache, if it may grow.
+// Returns 0, or -1 if it may not, or memory is short.
+static int
+bgrow(void)
+{
+  struct buf *b;
+  char *mem;
+  int i;
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  acquire(&bcache.lock);
+  if(bcache.nbuf + BPERPG > bcache.maxbuf ||
+     kfreepages() < bcache.minfree)
+    goto bad;
+  if(bcache.nhdr < BPERPG){
+    if((mem = kalloc()) == 0)
+      goto bad;
+    memset(mem, 0, PGSIZE);
+    bcache.hdr = (struct buf*)mem;
+    bcache.nhdr = PGSIZE / sizeof(struct buf);
+  }
+  if((mem = kalloc()) == 0)
+    goto bad;
+  for(i = 0; i < BPERPG; i++){
+    b = bcache.hdr++;
+    bcache.nhdr--;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->data = (uchar*)mem + i*BSIZE;
+    bfree(b);
   }
+  bcache.nbuf += BPERPG;
+  release(&bcache.lock);
+  return 0;
+
+ bad:
+  release(&bcache.lock);
+  return -1;
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
+// Take slot i out of its A1out hash chain, and empty it.
+// Caller holds bghost.lock.
+static void
+bghostunlink(int i)
+{
+  int *pp;
+
+  for(pp = &bghost.hash[GHASH(bghost.id[i].dev, bghost.id[i].blockno)];
+      *pp != -1; pp = &bghost.id[*pp].hnext){
+    if(*pp == i){
+      *pp = bghost.id[i].hnext;
+      break;
+    }
+  }
+  bghost.id[i].dev = 0;
+}
+
+// Remember a block recycled from A1in,
+// forgetting the oldest if A1out is full.
+static void
+bghostadd(uint dev, uint blockno)
+{
+  int i, h = GHASH(dev, blockno);
+
+  acquire(&bghost.lock);
+  i = bghost.next;
+  if(bghost.id[i].dev)
+    bghostunlink(i);
+  bghost.id[i].dev = dev;
+  bghost.id[i].blockno = blockno;
+  bghost.id[i].hnext = bghost.hash[h];
+  bghost.hash[h] = i;
+  bghost.next = (i + 1) % NGHOST;
+  release(&bghost.lock);
+}
+
+// Was the block recycled from A1in lately? If so, forget it.
+static int
+bghostfind(uint dev, uint blockno)
+{
+  int i;
+
+  acquire(&bghost.lock);
+  for(i = bghost.hash[GHASH(dev, blockno)]; i != -1; i = bghost.id[i].hnext){
+    if(bghost.id[i].dev == dev && bghost.id[i].blockno == blockno){
+      bghostunlink(i);
+      release(&bghost.lock);
+      return 1;
+    }
+  }
+  release(&bghost.lock);
+  return 0;
+}
+
+// The buffer in bk for block blockno on device dev,
+// or 0. Caller holds bk->lock.
 static struct buf*
-bget(uint dev, uint blockno)
+bfind(struct bucket *bk, uint dev, uint blockno)
 {
   struct buf *b;
 
-  acquire(&bcache.lock);
-
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
+  for(b = bk->head; b; b = b->next)
+    if(b->dev == dev && b->blockno == blockno)
       return b;
+  return 0;
+}
+
+// Take b out of bk, if it is there. Returns 1 if it
+// was. Caller holds bk->lock.
+static int
+bunlink(struct bucket *bk, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bk->head; *pp; pp = &(*pp)->next){
+    if(*pp == b){
+      *pp = b->next;
+      return 1;
     }
   }
+  return 0;
+}
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
+// Choose an unused buffer to recycle: a free one if there is
+// one, else the oldest in A1in if A1in has more than its share,
+// else the least recently used in Am. Take it out of its bucket
+// and its list and return it, or 0 if every buffer is in use.
+// Caller holds no bucket lock.
+static struct buf*
+bvictim(void)
+{
+  struct bqueue *q;
+  struct bucket *bk;
+  struct buf *b;
+  int i, qi, order[NBQUEUE];
+  uint dev, blockno;
+
+  q = &bcache.queue[BFREE];
+  acquire(&q->lock);
+  if((b = q->head) != 0)
+    qremove(q, b);
+  release(&q->lock);
+  if(b)
+    return b;
+
+  for(;;){
+    order[0] = __atomic_load_n(&bcache.queue[BA1IN].n, __ATOMIC_RELAXED) >
+               bcache.nbuf / 4 ? BA1IN : BAM;
+    order[1] = order[0] == BA1IN ? BAM : BA1IN;
+    dev = blockno = 0;
+    for(i = 0; i < 2 && b == 0; i++){
+      qi = order[i];
+      q = &bcache.queue[qi];
+      // in-use buffers are skipped; only a few can be.
+      acquire(&q->lock);
+      for(b = q->head; b && b->refcnt != 0; b = b->qnext)
+        ;
+      if(b){
+        dev = b->dev;
+        blockno = b->blockno;
+      }
+      release(&q->lock);
+    }
+    if(b == 0)
+      return 0;
+
+    // b may have been used, or recycled, since.
+    bk = bbucket(dev, blockno);
+    acquire(&bk->lock);
+    if(b->refcnt == 0 && b->queue == qi && b->dev == dev &&
+       b->blockno == blockno && bunlink(bk, b)){
+      acquire(&q->lock);
+      qremove(q, b);
+      release(&q->lock);
+      release(&bk->lock);
+      if(qi == BA1IN)
+        bghostadd(dev, blockno);
       return b;
     }
+    release(&bk->lock);
+    b = 0;
+  }
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return locked buffer; or, if every
+// buffer is in use, 0 if try is set, else panic.
+static struct buf*
+bget1(uint dev, uint blockno, int try)
+{
+  struct bucket *bk = bbucket(dev, blockno);
+  struct bqueue *q;
+  struct buf *b, *nb;
+
+  acquire(&bk->lock);
+
+  // Is the block already cached?
+  // (with bk->lock held, cpuid() stays put.)
+  if((b = bfind(bk, dev, blockno)) != 0){
+    cpubstat[cpuid()].hits++;
+    goto found;
+  }
+  release(&bk->lock);
+
+  // Not cached.
+  // Recycle a buffer, after adding some if there are
+  // none free and the cache may grow.
+  if(__atomic_load_n(&bcache.queue[BFREE].n, __ATOMIC_RELAXED) == 0)
+    bgrow();
+  if((nb = bvictim()) == 0){
+    if(try)
+      return 0;
+    panic("bget: no buffers");
+  }
+
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0){
+    // cached while bk was unlocked; nb stays free.
+    bfree(nb);
+    cpubstat[cpuid()].hits++;
+    goto found;
   }
-  panic("bget: no buffers");
+  b = nb;
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  if(bghostfind(dev, blockno)){
+    b->queue = BAM;
+    cpubstat[cpuid()].ghosthits++;
+  } else {
+    b->queue = BA1IN;
+  }
+  q = &bcache.queue[b->queue];
+  acquire(&q->lock);
+  qappend(q, b);
+  release(&q->lock);
+  b->next = bk->head;
+  bk->head = b;
+  cpubstat[cpuid()].misses++;
+ found:
+  b->refcnt++;
+  release(&bk->lock);
+  acquiresleep(&b->lock);
+  return b;
+}
+
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  return bget1(dev, blockno, 0);
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -102,6 +449,64 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Drop a reference to b, whose lock is released.
+// If it is on Am, it becomes the most recently used there.
+static void
+bput(struct buf *b)
+{
+  struct bucket *bk = bbucket(b->dev, b->blockno);
+  struct bqueue *q = &bcache.queue[BAM];
+
+  acquire(&bk->lock);
+  b->refcnt--;
+  if (b->refcnt == 0 && b->queue == BAM) {
+    // no one is waiting for it.
+    acquire(&q->lock);
+    qremove(q, b);
+    qappend(q, b);
+    release(&q->lock);
+  }
+  release(&bk->lock);
+}
+
+// Start reading the indicated block into the cache, if it is
+// not there already, without waiting for the disk. For
+// read-ahead: a bread() of the block meanwhile waits for the
+// read to finish, as it waits for the buffer's lock. Skipped
+// if every buffer is in use.
+void
+bprefetch(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bget1(dev, blockno, 1)) == 0)
+    return;
+  if(b->valid){
+    brelse(b);
+    return;
+  }
+  // the disk holds it now; acquiresleep() should not
+  // spin waiting for this process to release it.
+  sleephandoff(&b->lock);
+  if(virtio_disk_start(b) < 0){
+    brelse(b);
+    return;
+  }
+  push_off();
+  cpubstat[cpuid()].readahead++;
+  pop_off();
+}
+
+// Called by virtio_disk_intr() when the read that bprefetch()
+// started is done: release b, as its reader would.
+void
+bdone(struct buf *b)
+{
+  b->valid = 1;
+  releasesleep(&b->lock);
+  bput(b);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -112,7 +517,6 @@ bwrite(struct buf *b)
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
 void
 brelse(struct buf *b)
 {
@@ -120,34 +524,76 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
-
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+  bput(b);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bbucket(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bbucket(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
+// Forget every cached block not in use, putting its buffer on
+// the free list, so that it is next read from the disk: for
+// tests and benchmarks that want a cold cache. Unused buffers
+// are clean, since the log holds a reference to each buffer
+// it has yet to write home.
+void
+bdrop(void)
+{
+  struct bucket *bk;
+  struct bqueue *q;
+  struct buf *b, **pp;
 
+  for(bk = bcache.bucket; bk < &bcache.bucket[NBUCKET]; bk++){
+    acquire(&bk->lock);
+    for(pp = &bk->head; (b = *pp) != 0; ){
+      if(b->refcnt != 0){
+        pp = &b->next;
+        continue;
+      }
+      *pp = b->next;
+      q = &bcache.queue[b->queue];
+      acquire(&q->lock);
+      qremove(q, b);
+      release(&q->lock);
+      b->valid = 0;
+      bfree(b);
+    }
+    release(&bk->lock);
+  }
+}
+
+// Copy the cache's counts, as a struct bstat,
+// to user address addr. Returns 0, or -1.
+int
+bstatcopy(uint64 addr)
+{
+  struct bstat st;
+  int c;
+
+  memset(&st, 0, sizeof(st));
+  for(c = 0; c < NCPU; c++){
+    st.hits += cpubstat[c].hits;
+    st.misses += cpubstat[c].misses;
+    st.ghosthits += cpubstat[c].ghosthits;
+    st.readahead += cpubstat[c].readahead;
+  }
+  st.nbuf = bcache.nbuf;
+  st.maxbuf = bcache.maxbuf;
+  st.ncold = bcache.queue[BA1IN].n;
+  st.nhot = bcache.queue[BAM].n;
+  return copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st));
+}
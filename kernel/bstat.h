@@ -0,0 +1,11 @@
+// Disk block cache counts, read with bstat() (bio.c).
+struct bstat {
+  uint64 hits;        // lookups that found the block cached
+  uint64 misses;      // lookups that had to read it in
+  uint64 ghosthits;   // misses on blocks lately recycled from A1in
+  uint64 readahead;   // reads started ahead of readi() (fs.c)
+  int nbuf;           // buffers allocated
+  int maxbuf;         // most there may be
+  int ncold;          // buffers on A1in, blocks read in once
+  int nhot;           // on Am, blocks read in again from A1out
+};
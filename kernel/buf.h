@@ -5,8 +5,10 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
-  uchar data[BSIZE];
+  int queue;        // 2Q list it is on (bio.c)
+  struct buf *qprev; // on that list, in the order to recycle
+  struct buf *qnext;
+  struct buf *next; // next in its hash bucket (bio.c)
+  uchar *data;      // BSIZE bytes, in a page shared with other bufs
 };
 
@@ -107,10 +107,16 @@ consoleread(int user_dst, uint64 dst, int n)
       break;
     }
 
-    // copy the input byte to the user-space buffer.
+    // copy the input byte to the user-space buffer,
+    // without cons.lock: either_copyout() may sleep to
+    // read a swapped-out page back in.
     cbuf = c;
-    if(either_copyout(user_dst, dst, &cbuf, 1) == -1)
+    release(&cons.lock);
+    if(either_copyout(user_dst, dst, &cbuf, 1) == -1){
+      acquire(&cons.lock);
       break;
+    }
+    acquire(&cons.lock);
 
     dst++;
     --n;
@@ -1,13 +1,24 @@
 struct buf;
 struct context;
+struct cpu;
 struct file;
+struct fpstate;
 struct inode;
+struct lockstat;
+struct mm;
+struct page;
 struct pipe;
 struct proc;
+struct rcuhead;
+struct ringsqe;
 struct spinlock;
 struct sleeplock;
+struct spawnaction;
 struct stat;
 struct superblock;
+struct tracerec;
+struct vdsoproc;
+struct vma;
 
 // proc.c schedulers
 // void            fcfs(struct cpu*);
@@ -25,14 +36,25 @@ void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bstatcopy(uint64);
+void            bdrop(void);
+void            bprefetch(uint, uint);
+void            bdone(struct buf*);
 
 // console.c
 void            consoleinit(void);
 void            consoleintr(int);
 void            consputc(int);
 
+// event.c
+extern uint     evmask;
+void            eventinit(void);
+void            evrecord(int, uint64, uint64);
+int             evtrace(int);
+
 // exec.c
 int             exec(char*, char**);
+int             kexec(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
@@ -72,6 +94,15 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kfreechain(void*);
+uint64          kfreepages(void);
+
+// lockstat.c
+struct lockstat* lockclass(char*, int);
+uint64          lockstatacquired(struct lockstat*, uint64);
+void            lockstatreleased(struct lockstat*, uint64);
+void            lockstatspun(struct lockstat*, int);
+int             lockstatcopy(uint64, int);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -94,11 +125,18 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
-int             growproc(int);
+int             spawn(char*, char**, struct spawnaction*, int);
+int             clone(uint64, uint64, uint64);
+int             join(uint64);
+int             kthread(void (*)(void));
+void            mmbegin(struct proc*);
+void            mmend(struct proc*);
+void            mmquiesce(struct proc*);
+int             growproc(int, uint64*);
 int             waitx(uint64, uint*, uint*);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
-void            proc_freepagetable(pagetable_t, uint64);
+void            proc_freepagetable(pagetable_t, uint64, uint64);
 int             kill(int);
 int             killed(struct proc*);
 void            setkilled(struct proc*);
@@ -118,6 +156,11 @@ int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
 void            update_time(void);
 
+// prof.c
+void            profinit(void);
+void            profsample(uint64);
+int             profile(int);
+
 /////////////////// CREATED SYSCALLS//////////////////////
 // strace.c
 void            strace(int);
@@ -140,11 +183,13 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+int             lockbench(int);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
+void            sleephandoff(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
 // string.c
@@ -162,8 +207,13 @@ int             argstr(int, char*, int);
 void            argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
+int             sysstatcopy(uint64, int);
+void            traceexit(int);
 void            syscall();
 
+// sysfile.c
+int             ringop(struct ringsqe*);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
@@ -181,32 +231,135 @@ int             uartgetc(void);
 // vm.c
 void            kvminit(void);
 void            kvminithart(void);
+void            asidinit(void);
+void            uvmflush(struct proc*, uint64, uint64);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
+pagetable_t     kvmcreate(void);
+void            kvmsync(pagetable_t, pagetable_t);
+void            kvmfree(pagetable_t);
+void            kvmactivate(struct proc*);
+void            kvmdeactivate(void);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
+void*           uvmshrink(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+int             uvmfault(pagetable_t, uint64);
+uint64          uvmpin(pagetable_t, uint64);
+void            uvmunpin(void);
+struct vma*     vmaalloc(struct proc*, uint64);
+struct vma*     vmalookup(struct proc*, uint64);
+void            uvmcount(pagetable_t, uint64, int*, int*);
 pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 
+// fp.c
+void            fpswitch(struct proc*);
+int             fptrap(struct proc*);
+uint64          fpuserfs(struct proc*);
+void            fpfork(struct proc*, struct proc*);
+void            fpreset(struct proc*);
+void            fpsave(struct proc*, struct fpstate*);
+void            fprestore(struct proc*, struct fpstate*);
+
+// fpregs.S
+void            fpstore(struct fpstate*);
+void            fpload(struct fpstate*);
+
+// futex.c
+void            futexinit(void);
+int             futexwait(uint64, int, int);
+int             futexwake(uint64, int);
+
+// mmap.c
+uint64          mmap(int, int, int, struct file*, int);
+int             munmap(uint64, uint64);
+int             mmapsync(struct file*);
+int             mmapfault(struct proc*, uint64);
+void            mmapprefault(uint64, int);
+int             mmapfork(struct proc*, struct proc*);
+void            munmapall(struct proc*);
+
+// pcache.c
+void            pcinit(void);
+struct page*    pcget(struct inode*, uint);
+struct page*    pcfill(struct inode*, uint);
+void            pcput(struct page*);
+void            pcunmap(uint64);
+void            pcinval(struct inode*);
+int             pcreclaim(void);
+
 // plic.c
 void            plicinit(void);
 void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
 
+// rcu.c
+void            rcuinit(void);
+void            rcureadlock(void);
+void            rcureadunlock(void);
+void            rcuquiesce(struct cpu*);
+void            rcudefer(struct rcuhead*, void (*)(void*), void*);
+int             rcupending(void);
+void            rcusync(void);
+
+// ring.c
+uint64          ringsetup(int);
+int             ringenter(int, int);
+void            ringstop(struct mm*);
+void            ringfree(struct proc*);
+
+// shm.c
+void            shminit(void);
+int             shmget(int, int);
+uint64          shmat(int);
+int             shmdt(uint64);
+int             shmfork(struct proc*, struct proc*);
+void            shmdetachall(struct proc*);
+
+// swap.c
+void            swapinit(void);
+void*           swapkalloc(void);
+int             swapin(pagetable_t, uint64);
+void            swapread(pte_t, void*);
+void            swapfree(pte_t);
+
+// trace.c
+void            traceinit(void);
+void            tracepush(struct tracerec*);
+
+// vdso.c
+void            vdsoinit(void);
+void            vdsotick(void);
+struct vdsoproc* vdsoprocalloc(int);
+int             vdsomap(pagetable_t, struct mm*);
+void            vdsounmap(pagetable_t);
+
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+int             virtio_disk_start(struct buf *);
+void            virtio_disk_rwpage(uint, void*, int);
 void            virtio_disk_intr(void);
 
+// record an event of type ty, with a and b, if category
+// cat is enabled (event.c); if not, only test evmask.
+#define TRACEPOINT(cat, ty, a, b) \
+  do { if(__builtin_expect(evmask & (cat), 0)) evrecord((ty), (a), (b)); } while(0)
+
+// load a pointer that an RCU reader follows, or publish
+// one, after setting up what it points to (rcu.c).
+#define rcuderef(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+#define rcuassign(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -0,0 +1,134 @@
+//
+// Kernel event tracing.
+//
+// Tracepoints (TRACEPOINT() in defs.h) test their category in
+// evmask, a single branch when it is off, and otherwise call
+// evrecord(), which appends a struct event to this CPU's ring
+// with interrupts off and no lock, overwriting the oldest event
+// if the ring is full. evtrace() sets evmask. Reading the event
+// device takes events out of the rings, oldest first for each
+// CPU, and returns 0 once they are empty; a reader checks, as in
+// trace.c, that each event was not overwritten as it copied it,
+// and reports those that were with an EV_LOST event.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "defs.h"
+#include "event.h"
+
+#define NEVENT 512    // events in each CPU's ring
+
+struct evring {
+  uint head;          // events recorded; written only by this CPU
+  uint tail;          // events read or lost; under evlk
+  struct event ev[NEVENT];
+};
+
+uint evmask;
+static struct evring evrings[NCPU];
+static struct sleeplock evlk;
+
+// Record an event on this CPU. Called by TRACEPOINT().
+void
+evrecord(int type, uint64 a, uint64 b)
+{
+  struct evring *r;
+  struct event *e;
+  struct proc *p;
+
+  push_off();
+  r = &evrings[cpuid()];
+  e = &r->ev[r->head % NEVENT];
+  e->time = r_time();
+  e->type = type;
+  e->cpu = cpuid();
+  p = mycpu()->proc;
+  e->pid = p ? p->pid : 0;
+  e->a = a;
+  e->b = b;
+  __sync_synchronize();
+  r->head++;
+  pop_off();
+}
+
+// Enable the tracepoints in the categories in mask, and
+// disable the others. Returns the previous mask.
+int
+evtrace(int mask)
+{
+  return __atomic_exchange_n(&evmask, mask, __ATOMIC_SEQ_CST);
+}
+
+// Take the next event from r, if there is one, into *e, or
+// if r dropped some since the last, an EV_LOST event for them.
+// Returns 1 if there was one, 0 if not. Caller holds evlk.
+static int
+evpop(struct evring *r, struct event *e, int cpu)
+{
+  uint head, lost = 0;
+
+  for(;;){
+    head = r->head;
+    if(r->tail == head)
+      break;
+    if(head - r->tail > NEVENT){
+      lost += head - NEVENT - r->tail;
+      r->tail = head - NEVENT;
+    }
+    if(lost > 0)
+      break;
+    __sync_synchronize();
+    *e = r->ev[r->tail % NEVENT];
+    __sync_synchronize();
+    // did the CPU start to overwrite the event as we copied it?
+    if(r->head - r->tail < NEVENT){
+      r->tail++;
+      return 1;
+    }
+    lost++;
+    r->tail++;
+  }
+  if(lost == 0)
+    return 0;
+  memset(e, 0, sizeof(*e));
+  e->type = EV_LOST;
+  e->cpu = cpu;
+  e->a = lost;
+  return 1;
+}
+
+// Read whole events into dst, until there are no more.
+static int
+evread(int user_dst, uint64 dst, int n)
+{
+  struct event e;
+  int c, got = 0;
+
+  acquiresleep(&evlk);
+  for(c = 0; c < NCPU; c++){
+    while(n - got >= sizeof(e) && evpop(&evrings[c], &e, c)){
+      if(either_copyout(user_dst, dst + got, &e, sizeof(e)) < 0){
+        releasesleep(&evlk);
+        return got > 0 ? got : -1;
+      }
+      got += sizeof(e);
+    }
+  }
+  releasesleep(&evlk);
+  return got;
+}
+
+void
+eventinit(void)
+{
+  initsleeplock(&evlk, "events");
+  devsw[EVENTS].read = evread;
+}
@@ -0,0 +1,33 @@
+// Kernel events, recorded by tracepoints whose categories
+// evtrace() has enabled, and read from the event device
+// (event.c) as struct events, for evdump.
+
+// categories, for evtrace()'s mask
+#define EVC_SCHED   (1 << 0)
+#define EVC_WAKEUP  (1 << 1)
+#define EVC_DISK    (1 << 2)
+#define EVC_LOG     (1 << 3)
+#define EVC_KALLOC  (1 << 4)
+#define EVC_TRAP    (1 << 5)
+
+// event.type, with what a and b hold
+#define EV_LOST        0  // a: events this CPU dropped just before
+#define EV_SWITCHOUT   1  // a: the state pid leaves the CPU in
+#define EV_SWITCHIN    2  // pid runs again
+#define EV_WAKEUP      3  // a: pid made RUNNABLE, b: the channel
+#define EV_DISKSTART   4  // a: sector, b: 1 if a write
+#define EV_DISKDONE    5  // a: sector, from the disk interrupt
+#define EV_BEGINOP     6  // a: file system operations now outstanding
+#define EV_COMMIT      7  // a: blocks in the transaction
+#define EV_COMMITDONE  8
+#define EV_KALLOC      9  // a: the page, or 0 if none was free
+#define EV_TRAP       10  // a: scause, b: sepc, of a trap from user space
+
+struct event {
+  uint64 time;      // time CSR
+  ushort type;
+  ushort cpu;
+  int pid;          // running on cpu, or 0
+  uint64 a;
+  uint64 b;
+};
@@ -6,6 +6,7 @@
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
+#include "vdso.h"
 
 static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
 
@@ -21,6 +22,15 @@ int flags2perm(int flags)
 
 int
 exec(char *path, char **argv)
+{
+  return kexec(myproc(), path, argv);
+}
+
+// Replace p's user memory with the program in path, run
+// with arguments argv. p is the caller, or a child made by
+// spawn() that has not run yet.
+int
+kexec(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
@@ -29,7 +39,11 @@ exec(char *path, char **argv)
   struct inode *ip;
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
+
+  // the other threads would be left running in
+  // the old image; they must be joined first.
+  if(p->mm->ref > 1)
+    return -1;
 
   begin_op();
 
@@ -72,8 +86,7 @@ exec(char *path, char **argv)
   end_op();
   ip = 0;
 
-  p = myproc();
-  uint64 oldsz = p->sz;
+  uint64 oldsz = p->mm->sz;
 
   // Allocate two pages at the next page boundary.
   // Make the first inaccessible as a stack guard.
@@ -121,18 +134,27 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  munmapall(p);
+  shmdetachall(p);
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
-  p->sz = sz;
+  kvmsync(p->kpagetable, pagetable);
+  p->mm->guard = stackbase - PGSIZE;
+  p->mm->asid = 0;   // the old ASID's TLB entries belong to the old image
+  p->mm->tlbharts = 0;
+  p->mm->sz = sz;
+  p->mm->vdsoproc->pid = p->pid;  // p is the only thread now
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
+  fpreset(p);
+  proc_freepagetable(oldpagetable, oldsz, p->trapframeva);
+  p->trapframeva = TRAPFRAME;
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
   if(pagetable)
-    proc_freepagetable(pagetable, sz);
+    proc_freepagetable(pagetable, sz, TRAPFRAME);
   if(ip){
     iunlockput(ip);
     end_op();
@@ -3,3 +3,20 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+
+// mmap() protection and flags
+#define PROT_READ    0x1
+#define PROT_WRITE   0x2
+#define MAP_SHARED   0x01
+#define MAP_PRIVATE  0x02
+
+// spawn() file actions, applied in order to the child's
+// copy of the caller's open files. The list ends with op 0.
+#define SPAWN_DUP2   1   // make newfd refer to fd's file
+#define SPAWN_CLOSE  2   // close fd
+
+struct spawnaction {
+  int op;
+  int fd;
+  int newfd;
+};
@@ -18,6 +18,9 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct page *pages; // cached pages of the file (pcache.c)
+  struct inode *hashnext; // next in itable hash chain, or free list
+  struct rcuhead rcu; // puts it on the free list once unused
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -27,6 +30,21 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  // read-ahead, by readi().
+  uint ranext;        // offset the last read ended at
+  uint raend;         // block read ahead up to
+  int rawin;          // blocks to keep read ahead
+};
+
+// a page of file data in the page cache (pcache.c).
+// pcache.lock protects everything here.
+struct page {
+  struct inode *ip;   // file it belongs to; 0 if free or dropped
+  uint off;           // offset in the file, page-aligned
+  uint64 pa;          // physical address; 0 if the entry is free
+  int ref;            // mappings and other users
+  struct page *next;  // next of ip's cached pages
 };
 
 // map major device number to device functions.
@@ -38,3 +56,6 @@ struct devsw {
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define TRACE   2  // system call records (trace.c)
+#define EVENTS  3  // kernel events (event.c)
+#define PROFILE 4  // profile samples (prof.c)
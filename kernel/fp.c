@@ -0,0 +1,128 @@
+//
+// Floating-point registers for user code, switched lazily.
+//
+// A process returns to user space with sstatus.FS Off, so that
+// its first FP instruction traps, unless this hart's FP registers
+// already hold its state. fptrap() then loads p->fpstate and lets
+// the instruction run again. The hardware sets FS to Dirty when a
+// register changes, and only then does sched() save them; a
+// process that never uses FP pays for neither the trap nor the
+// saves, and one that does is only reloaded if another process
+// has used this hart's registers since, or it has moved harts.
+//
+// The kernel itself never uses the FP registers.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+// Do this hart's FP registers hold p's state?
+// Interrupts must be disabled.
+static int
+fpmine(struct proc *p)
+{
+  return mycpu()->fpproc == p && p->fpcpu == cpuid();
+}
+
+static void
+fpsetfs(uint64 fs)
+{
+  w_sstatus((r_sstatus() & ~SSTATUS_FS) | fs);
+}
+
+// Save p's FP registers in p->fpstate, if p has changed them
+// since they were last saved. They stay loaded, and Clean.
+// Interrupts must be disabled.
+static void
+fpflush(struct proc *p)
+{
+  if((r_sstatus() & SSTATUS_FS) == SSTATUS_FS_DIRTY && fpmine(p)){
+    fpstore(&p->fpstate);
+    fpsetfs(SSTATUS_FS_CLEAN);
+  }
+}
+
+// Called by sched() as p gives up the hart.
+void
+fpswitch(struct proc *p)
+{
+  fpflush(p);
+}
+
+// Handle an illegal-instruction trap from p's user code, which
+// may be its first FP instruction since it last ran on this hart.
+// Returns 0 if it was, and the instruction should run again.
+// Interrupts must be disabled.
+int
+fptrap(struct proc *p)
+{
+  if((r_sstatus() & SSTATUS_FS) != SSTATUS_FS_OFF)
+    return -1;
+
+  // whichever process last used these registers
+  // saved them in sched(), if it had changed them.
+  fpsetfs(SSTATUS_FS_INITIAL);
+  fpload(&p->fpstate);
+  fpsetfs(SSTATUS_FS_CLEAN);
+  mycpu()->fpproc = p;
+  p->fpcpu = cpuid();
+  return 0;
+}
+
+// The sstatus.FS for p's return to user space.
+// Interrupts must be disabled.
+uint64
+fpuserfs(struct proc *p)
+{
+  if(fpmine(p))
+    return r_sstatus() & SSTATUS_FS;
+  return SSTATUS_FS_OFF;
+}
+
+// Give np, made by fork() or clone(), a copy of p's FP registers.
+void
+fpfork(struct proc *p, struct proc *np)
+{
+  push_off();
+  fpflush(p);
+  pop_off();
+  np->fpstate = p->fpstate;
+}
+
+// Copy p's FP registers to fs, as the sigalarm() handler
+// is entered, for sigreturn() to put back with fprestore().
+void
+fpsave(struct proc *p, struct fpstate *fs)
+{
+  push_off();
+  fpflush(p);
+  pop_off();
+  *fs = p->fpstate;
+}
+
+// Make fs p's FP registers. Those the handler left
+// in this hart are dropped; the next FP instruction
+// loads fs with fptrap().
+void
+fprestore(struct proc *p, struct fpstate *fs)
+{
+  push_off();
+  p->fpstate = *fs;
+  if(fpmine(p))
+    mycpu()->fpproc = 0;
+  p->fpcpu = -1;
+  pop_off();
+}
+
+// Start p's FP registers afresh, for a new process or exec().
+void
+fpreset(struct proc *p)
+{
+  memset(&p->fpstate, 0, sizeof(p->fpstate));
+  p->fpcpu = -1;
+}
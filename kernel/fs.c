@@ -44,6 +44,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  swapinit();
 }
 
 // Zero a block.
@@ -130,11 +131,13 @@ bfree(int dev, uint b)
 //   the reference and link counts have fallen to zero.
 //
 // * Referencing in table: an entry in the inode table
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
+//   is unused if ip->ref is zero. Otherwise ip->ref tracks
 //   the number of in-memory pointers to the entry (open
 //   files and current directories). iget() finds or
 //   creates a table entry and increments its ref; iput()
-//   decrements ref.
+//   decrements ref, and once it is zero takes the entry
+//   out of the table's hash and, after an RCU grace period
+//   (rcu.c), puts it on the free list for reuse.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   table entry is only correct when ip->valid is 1.
@@ -165,17 +168,27 @@ bfree(int dev, uint b)
 // multi-step atomic operations.
 //
 // The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// entries, the hash, and the free list; ip->dev and ip->inum
+// only change while an entry is free. ip->ref changes
+// atomically; it goes from 0 to 1, or to 0, only with
+// itable.lock held. iget() searches the hash for an inode in
+// use without the lock, as an RCU reader, and then takes a
+// reference only if ip->ref is not already 0; since an unused
+// entry is not reused until the grace period after, its dev
+// and inum are still what the search matched.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 31
+#define IHASH(dev, inum) (((dev) * 7 + (inum)) % NIHASH)
+
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct inode *hash[NIHASH];  // inodes in use, by dev and inum
+  struct inode *free;          // inodes that may be reused
 } itable;
 
 void
@@ -186,6 +199,8 @@ iinit()
   initlock(&itable.lock, "itable");
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&itable.inode[i].lock, "inode");
+    itable.inode[i].hashnext = itable.free;
+    itable.free = &itable.inode[i];
   }
 }
 
@@ -240,37 +255,98 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
+// Take a reference to ip, unless it has none left.
+static int
+irefget(struct inode *ip)
+{
+  int r;
+
+  while((r = __atomic_load_n(&ip->ref, __ATOMIC_RELAXED)) > 0)
+    if(__sync_bool_compare_and_swap(&ip->ref, r, r + 1))
+      return 1;
+  return 0;
+}
+
+// Search the hash for the inode in use with number
+// inum on device dev, and take a reference to it.
+static struct inode*
+ilookup(uint dev, uint inum)
+{
+  struct inode *ip;
+
+  rcureadlock();
+  for(ip = rcuderef(itable.hash[IHASH(dev, inum)]); ip; ip = rcuderef(ip->hashnext))
+    if(ip->dev == dev && ip->inum == inum && irefget(ip))
+      break;
+  rcureadunlock();
+  return ip;
+}
+
+// Put ip on the free list, once ilookup()s
+// that might have been at ip are done.
+static void
+ifreed(void *arg)
+{
+  struct inode *ip = arg;
+
+  acquire(&itable.lock);
+  ip->hashnext = itable.free;
+  itable.free = ip;
+  release(&itable.lock);
+}
+
+// Take ip, whose ref has gone to 0, out of
+// the hash. Caller holds itable.lock.
+static void
+iunhash(struct inode *ip)
+{
+  struct inode **pp;
+
+  for(pp = &itable.hash[IHASH(ip->dev, ip->inum)]; *pp; pp = &(*pp)->hashnext){
+    if(*pp == ip){
+      *pp = ip->hashnext;
+      break;
+    }
+  }
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
-
-  acquire(&itable.lock);
+  struct inode *ip;
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&itable.lock);
-      return ip;
-    }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+  if((ip = ilookup(dev, inum)) != 0)
+    return ip;
+
+  acquire(&itable.lock);
+  // it may have been added since, but only with the lock.
+  while((ip = ilookup(dev, inum)) == 0 && itable.free == 0){
+    // unused entries may be waiting out a grace period.
+    if(!rcupending())
+      panic("iget: no inodes");
+    release(&itable.lock);
+    rcusync();
+    acquire(&itable.lock);
+  }
+  if(ip){
+    release(&itable.lock);
+    return ip;
   }
 
   // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
+  ip = itable.free;
+  itable.free = ip->hashnext;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->ranext = ip->raend = ip->rawin = 0;
+  ip->hashnext = itable.hash[IHASH(dev, inum)];
+  rcuassign(itable.hash[IHASH(dev, inum)], ip);
   release(&itable.lock);
 
   return ip;
@@ -281,9 +357,7 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&itable.lock);
-  ip->ref++;
-  release(&itable.lock);
+  __sync_fetch_and_add(&ip->ref, 1);
   return ip;
 }
 
@@ -336,12 +410,23 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
+  int last;
+
   acquire(&itable.lock);
 
-  if(ip->ref == 1 && ip->valid && ip->nlink == 0){
+  // only iget() and idup() change ref without the lock, and
+  // they only add to it: if ref goes from 1 to 0 here, ours
+  // was the last reference, and no more can be taken.
+  last = __sync_bool_compare_and_swap(&ip->ref, 1, 0);
+  if(!last)
+    __sync_fetch_and_sub(&ip->ref, 1);
+  else
+    iunhash(ip);
+
+  if(last && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
 
-    // ip->ref == 1 means no other process can have ip locked,
+    // ip->ref == 0 means no other process can have ip locked,
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
@@ -357,7 +442,11 @@ iput(struct inode *ip)
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(last){
+    // the entry may be reused for another inode.
+    pcinval(ip);
+    rcudefer(&ip->rcu, ifreed, ip);
+  }
   release(&itable.lock);
 }
 
@@ -429,6 +518,8 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  pcinval(ip);
+  ip->raend = 0;
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -464,15 +555,60 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Read ahead of readi()s that each carry on from where the
+// last left off, just before end: start reading the next
+// ip->rawin blocks into the cache, without waiting, skipping
+// those read ahead already. The window doubles with each such
+// read, up to READAHEAD, and closes when one does not follow.
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint off, uint end)
+{
+  uint bn, last, addr;
+
+  if(off == ip->ranext){
+    if(ip->rawin == 0)
+      ip->rawin = 2;
+    else if(ip->rawin < READAHEAD)
+      ip->rawin *= 2;
+  } else {
+    ip->rawin = 0;
+    ip->raend = 0;
+  }
+  ip->ranext = end;
+  if(ip->rawin == 0)
+    return;
+
+  // the block end is in, if any of it was read, is cached.
+  bn = (end + BSIZE - 1) / BSIZE;
+  last = bn + ip->rawin;
+  if(last > (ip->size + BSIZE - 1) / BSIZE)
+    last = (ip->size + BSIZE - 1) / BSIZE;
+  if(bn < ip->raend)
+    bn = ip->raend;
+  for(; bn < last; bn++){
+    // below ip->size, so bmap() does not allocate.
+    if((addr = bmap(ip, bn)) == 0)
+      break;
+    bprefetch(ip->dev, addr);
+  }
+  if(bn > ip->raend)
+    ip->raend = bn;
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
+// Data in the page cache is taken from there, since
+// a MAP_SHARED mapping may have changed it.
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  struct page *pg;
+  int r;
 
   if(off > ip->size || off + n < off)
     return 0;
@@ -480,6 +616,16 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    if((pg = pcget(ip, PGROUNDDOWN(off))) != 0){
+      m = min(n - tot, BSIZE - off%BSIZE);
+      r = either_copyout(user_dst, dst, (char*)pg->pa + (off % PGSIZE), m);
+      pcput(pg);
+      if(r == -1){
+        tot = -1;
+        break;
+      }
+      continue;
+    }
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
       break;
@@ -492,6 +638,8 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     }
     brelse(bp);
   }
+  if(tot != -1 && tot > 0)
+    readahead(ip, off - tot, off);
   return tot;
 }
 
@@ -502,11 +650,14 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 // Returns the number of bytes successfully written.
 // If the return value is less than the requested n,
 // there was an error of some kind.
+// A cached copy of the data in the page cache is
+// updated as well.
 int
 writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  struct page *pg;
 
   if(off > ip->size || off + n < off)
     return -1;
@@ -524,6 +675,14 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
       break;
     }
     log_write(bp);
+    // no copy when the cached page itself is being
+    // written back (mmap.c); a store through a mapping
+    // meanwhile would be lost.
+    if((pg = pcget(ip, PGROUNDDOWN(off))) != 0){
+      if(user_src || PGROUNDDOWN(src) != pg->pa)
+        memmove((char*)pg->pa + (off % PGSIZE), bp->data + (off % BSIZE), m);
+      pcput(pg);
+    }
     brelse(bp);
   }
 
@@ -655,8 +814,13 @@ namex(char *path, int nameiparent, char *name)
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
-  else
-    ip = idup(myproc()->cwd);
+  else {
+    // another thread may chdir() meanwhile.
+    struct mm *m = myproc()->mm;
+    acquire(&m->lock);
+    ip = idup(m->cwd);
+    release(&m->lock);
+  }
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
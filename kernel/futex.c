@@ -0,0 +1,163 @@
+//
+// Futexes: sleeping on a word of user memory.
+//
+// futexwait() sleeps as long as the word at a user address
+// holds an expected value, and futexwake() wakes processes
+// sleeping on the word. The value is checked, and the waiter
+// queued, under the lock of the word's hash bucket, so a wake
+// by a process that has just changed the word cannot be lost.
+// User code only enters the kernel when it must block, or when
+// someone may be blocked (see the mutex in user/ulib.c).
+//
+// A word in a shared-memory segment or a file mapping (above
+// MMAPBASE) is named by its physical address, so that processes
+// that map it at different addresses meet. Memory below MMAPBASE
+// can be swapped out and read back in to another physical page,
+// but only threads share it, so it is named by mm and address.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NFUTEXHASH 31
+
+struct futexwaiter {
+  struct mm *mm;        // 0 if addr is physical
+  uint64 addr;
+  int woken;
+  int timed;            // sleeping on ticks, not on the waiter
+  struct futexwaiter *next;
+};
+
+struct futexbucket {
+  struct spinlock lock;
+  struct futexwaiter *waiters;
+} futexes[NFUTEXHASH];
+
+void
+futexinit(void)
+{
+  struct futexbucket *b;
+
+  for(b = futexes; b < &futexes[NFUTEXHASH]; b++)
+    initlock(&b->lock, "futex");
+}
+
+// Name the int at user address va of p in w, and return
+// the bucket for it, locked, with the int's physical address
+// in *pa. Returns 0 if va is not user memory.
+static struct futexbucket*
+futexlock(struct proc *p, uint64 va, struct futexwaiter *w, uint64 *pa)
+{
+  struct futexbucket *b;
+
+  if(va % sizeof(int) != 0)
+    return 0;
+  // fault the page in, if it is swapped out or a file
+  // page not yet touched, and keep it until b is held.
+  if((*pa = uvmpin(p->pagetable, PGROUNDDOWN(va))) == 0)
+    return 0;
+  *pa += va % PGSIZE;
+
+  if(va >= MMAPBASE){
+    w->mm = 0;
+    w->addr = *pa;
+  } else {
+    w->mm = p->mm;
+    w->addr = va;
+  }
+  b = &futexes[(((uint64)w->mm ^ w->addr) / sizeof(int)) % NFUTEXHASH];
+  acquire(&b->lock);
+  uvmunpin();
+  return b;
+}
+
+// Sleep until woken by futexwake(), if the int at
+// user address va holds val. Gives up after timeout
+// ticks, if timeout > 0. Returns 0 if woken, or -1
+// if *va != val, on timeout, or if killed.
+int
+futexwait(uint64 va, int val, int timeout)
+{
+  struct proc *p = myproc();
+  struct futexbucket *b;
+  struct futexwaiter w, **pp;
+  uint64 pa;
+  uint ticks0;
+
+  if((b = futexlock(p, va, &w, &pa)) == 0)
+    return -1;
+  if(*(int*)pa != val){
+    release(&b->lock);
+    return -1;
+  }
+  w.woken = 0;
+  w.timed = timeout > 0;
+  w.next = b->waiters;
+  b->waiters = &w;
+
+  if(!w.timed){
+    while(!w.woken && !killed(p))
+      sleep(&w, &b->lock);
+  } else {
+    // futexwake() takes tickslock to wake a timed
+    // waiter, so w.woken can be checked under it.
+    release(&b->lock);
+    acquire(&tickslock);
+    ticks0 = ticks;
+    while(!w.woken && ticks - ticks0 < (uint)timeout && !killed(p))
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+    acquire(&b->lock);
+  }
+
+  if(!w.woken){
+    for(pp = &b->waiters; *pp; pp = &(*pp)->next){
+      if(*pp == &w){
+        *pp = w.next;
+        break;
+      }
+    }
+  }
+  release(&b->lock);
+  return w.woken ? 0 : -1;
+}
+
+// Wake up to n processes sleeping on the int at user
+// address va. Returns how many were woken, or -1.
+int
+futexwake(uint64 va, int n)
+{
+  struct proc *p = myproc();
+  struct futexbucket *b;
+  struct futexwaiter key, *w, **pp;
+  uint64 pa;
+  int woken = 0;
+
+  if((b = futexlock(p, va, &key, &pa)) == 0)
+    return -1;
+  for(pp = &b->waiters; *pp && woken < n; ){
+    w = *pp;
+    if(w->mm != key.mm || w->addr != key.addr){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->woken = 1;
+    if(w->timed){
+      acquire(&tickslock);
+      wakeup(&ticks);
+      release(&tickslock);
+    } else {
+      wakeup(w);
+    }
+    woken++;
+  }
+  release(&b->lock);
+  return woken;
+}
@@ -8,6 +8,7 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "defs.h"
+#include "event.h"
 
 void freerange(void *pa_start, void *pa_end);
 
@@ -21,6 +22,7 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
+  uint64 nfree;  // pages on freelist
 } kmem;
 
 void
@@ -59,6 +61,43 @@ kfree(void *pa)
   acquire(&kmem.lock);
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
+  release(&kmem.lock);
+}
+
+// Free a chain of pages, linked through their first
+// words and ending in 0, taking kmem.lock only once.
+void
+kfreechain(void *head)
+{
+  struct run *r, *first, *last;
+  void *next;
+  uint64 n;
+
+  if(head == 0)
+    return;
+
+  first = last = 0;
+  for(n = 0; head; n++){
+    next = *(void**)head;
+    if(((uint64)head % PGSIZE) != 0 || (char*)head < end || (uint64)head >= PHYSTOP)
+      panic("kfreechain");
+
+    // Fill with junk to catch dangling refs.
+    memset(head, 1, PGSIZE);
+
+    r = (struct run*)head;
+    r->next = first;
+    first = r;
+    if(last == 0)
+      last = r;
+    head = next;
+  }
+
+  acquire(&kmem.lock);
+  last->next = kmem.freelist;
+  kmem.freelist = first;
+  kmem.nfree += n;
   release(&kmem.lock);
 }
 
@@ -72,11 +111,21 @@ kalloc(void)
 
   acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.nfree--;
+  }
   release(&kmem.lock);
+  TRACEPOINT(EVC_KALLOC, EV_KALLOC, (uint64)r, 0);
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
 }
+
+// Return the number of free pages.
+uint64
+kfreepages(void)
+{
+  return __atomic_load_n(&kmem.nfree, __ATOMIC_RELAXED);
+}
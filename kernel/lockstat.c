@@ -0,0 +1,133 @@
+//
+// Lock contention statistics, when built with LOCKSTAT.
+//
+// initlock() and initsleeplock() point each lock at the
+// struct lockstat for its name and kind, shared by all the
+// locks of that name (a spinlock in each proc, say), and
+// acquire(), release() and their sleeplock counterparts add to
+// it with atomic instructions. Entries are only ever added,
+// under a plain test-and-set lock, since initlock() cannot
+// take a spinlock of its own.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "lockstat.h"
+
+#ifdef LOCKSTAT
+
+#define NLOCKSTAT 128
+
+static struct lockstat lockstats[NLOCKSTAT];
+static int nlockstat;
+static uint lockstatlock;
+
+// The entry for locks named name, of kind sleep, or 0 if
+// there is no room for another.
+struct lockstat*
+lockclass(char *name, int sleep)
+{
+  struct lockstat *s;
+  int i;
+
+  push_off();
+  while(__sync_lock_test_and_set(&lockstatlock, 1) != 0)
+    ;
+  __sync_synchronize();
+  for(i = 0; i < nlockstat; i++){
+    s = &lockstats[i];
+    if(s->sleep == sleep && strncmp(s->name, name, sizeof(s->name) - 1) == 0)
+      goto found;
+  }
+  if(nlockstat == NLOCKSTAT){
+    s = 0;
+    goto out;
+  }
+  s = &lockstats[nlockstat];
+  safestrcpy(s->name, name, sizeof(s->name));
+  s->sleep = sleep;
+  __sync_synchronize();
+  nlockstat++;
+ found:
+  __atomic_fetch_add(&s->nlock, 1, __ATOMIC_RELAXED);
+ out:
+  __sync_lock_release(&lockstatlock);
+  pop_off();
+  return s;
+}
+
+// Count an acquire of a lock of s's, after spins failed tries,
+// and return the time to measure its hold from.
+uint64
+lockstatacquired(struct lockstat *s, uint64 spins)
+{
+  if(s){
+    __atomic_fetch_add(&s->acquires, 1, __ATOMIC_RELAXED);
+    if(spins){
+      __atomic_fetch_add(&s->contended, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&s->spins, spins, __ATOMIC_RELAXED);
+    }
+  }
+  return r_time();
+}
+
+// Count a wait for a sleeplock of s's that spun while its
+// holder ran, and whether it went on to get the lock without
+// sleeping.
+void
+lockstatspun(struct lockstat *s, int won)
+{
+  if(s == 0)
+    return;
+  __atomic_fetch_add(&s->spinwaits, 1, __ATOMIC_RELAXED);
+  if(won){
+    // lockstatacquired() counts the waits that slept.
+    __atomic_fetch_add(&s->contended, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->spinwins, 1, __ATOMIC_RELAXED);
+  }
+}
+
+// Count the release of a lock of s's, held since start.
+void
+lockstatreleased(struct lockstat *s, uint64 start)
+{
+  uint64 t = r_time() - start;
+  uint64 max;
+
+  if(s == 0)
+    return;
+  __atomic_fetch_add(&s->holdtotal, t, __ATOMIC_RELAXED);
+  max = __atomic_load_n(&s->holdmax, __ATOMIC_RELAXED);
+  while(t > max &&
+        !__atomic_compare_exchange_n(&s->holdmax, &max, t, 0,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+#endif
+
+// Copy out up to n struct lockstats to user address addr.
+// Returns how many there are, or -1, as when the kernel
+// was built without LOCKSTAT.
+int
+lockstatcopy(uint64 addr, int n)
+{
+#ifdef LOCKSTAT
+  int i, nl = __atomic_load_n(&nlockstat, __ATOMIC_ACQUIRE);
+
+  if(n < 0)
+    return -1;
+  for(i = 0; i < n && i < nl; i++)
+    if(copyout(myproc()->pagetable, addr + i * sizeof(struct lockstat),
+               (char*)&lockstats[i], sizeof(struct lockstat)) < 0)
+      return -1;
+  return nl;
+#else
+  return -1;
+#endif
+}
@@ -0,0 +1,17 @@
+// Lock contention counts, kept when the kernel is built with
+// LOCKSTAT (make LOCKSTAT=1), and read with lockstat().
+
+// For all the locks of one name, spin or sleep, since boot.
+// Times are in time CSR counts (TIMEBASE per second, vdso.h).
+struct lockstat {
+  char name[16];
+  int sleep;          // 1 if sleeplocks
+  uint nlock;         // locks made with this name
+  uint64 acquires;
+  uint64 contended;   // acquires that had to wait
+  uint64 spins;       // failed tries, or sleeps for a sleeplock
+  uint64 spinwaits;   // sleeplock waits that spun on a running holder
+  uint64 spinwins;    // of those, ones that got it without sleeping
+  uint64 holdtotal;   // time held
+  uint64 holdmax;
+};
@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "event.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -135,6 +136,7 @@ begin_op(void)
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      TRACEPOINT(EVC_LOG, EV_BEGINOP, log.outstanding, 0);
       release(&log.lock);
       break;
     }
@@ -194,11 +196,13 @@ static void
 commit()
 {
   if (log.lh.n > 0) {
+    TRACEPOINT(EVC_LOG, EV_COMMIT, log.lh.n, 0);
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
     install_trans(0); // Now install writes to home locations
     log.lh.n = 0;
     write_head();    // Erase the transaction from the log
+    TRACEPOINT(EVC_LOG, EV_COMMITDONE, 0, 0);
   }
 }
 
@@ -19,14 +19,23 @@ main()
     kinit();         // physical page allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+    asidinit();      // address-space identifiers
     procinit();      // process table
+    rcuinit();       // RCU grace periods
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode table
+    pcinit();        // file page cache
     fileinit();      // file table
+    traceinit();     // system call trace device
+    eventinit();     // kernel event device
+    profinit();      // profile device
+    shminit();       // shared-memory segments
+    futexinit();     // futex wait queues
+    vdsoinit();      // the page of time for user space
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -53,6 +53,8 @@
 
 // map kernel stacks beneath the trampoline,
 // each surrounded by invalid guard pages.
+// p is the proc's slot, and its stack is mapped
+// when the proc is first used.
 #define KSTACK(p) (TRAMPOLINE - ((p)+1)* 2*PGSIZE)
 
 // User memory layout.
@@ -62,6 +64,36 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   MMAPBASE (shared memory and other mappings, up to USERTOP)
+//   ...
+//   USERTOP (the end of user memory)
+//   ...
+//   VDSOPROC (struct vdsoproc, read-only, per process)
+//   VDSO (struct vdso, read-only, shared by all processes)
+//   THREADFRAME(i) (p->trapframe of threads, for the proc in slot i)
+//   KSTACKBASE (kernel stacks: unmapped in user page tables)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
+//
+// a process's user and kernel page tables share its ASID
+// (kvmactivate()), so that a TLB entry from one may serve an
+// access through the other: pages only in the user page table
+// must lie where the kernel page table maps nothing, at
+// TRAPFRAME, above every stack, or below KSTACKBASE, the guard
+// page under the lowest (proc.c checks this).
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define KSTACKBASE (KSTACK(NPROC-1) - PGSIZE)
+#define THREADFRAME(i) (KSTACKBASE - ((i)+1)*PGSIZE)
+// the vDSO pages are in every user page table: beneath all of
+// the thread frames, not among the kernel stacks.
+#define VDSO (THREADFRAME(NPROC - 1) - PGSIZE)
+#define VDSOPROC (VDSO - PGSIZE)
+
+// user memory ends where the PLIC's mappings begin, since each
+// process's kernel page table (vm.c) maps user memory and the
+// devices through the same level-1 page-table page.
+#define USERTOP PLIC
+
+// the heap may grow up to MMAPBASE; mappings made by
+// shmat() and mmap() go between MMAPBASE and USERTOP.
+#define MMAPBASE (USERTOP - 32*1024*1024)
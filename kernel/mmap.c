@@ -0,0 +1,363 @@
+//
+// File mappings, made by mmap().
+//
+// mmap() only records a mapping in a struct vma; each page is
+// mapped by mmapfault() when it is first touched, from the page
+// cache (pcache.c). A MAP_SHARED mapping maps the cached page
+// itself, so all processes that map the file, and read() and
+// write(), see the same data. The pages it has written (PTE_D
+// set) are written back to the file through the log by fsync(),
+// munmap() and exit(). A MAP_PRIVATE mapping gets its own copy
+// of each page, and its changes are never written back.
+//
+// Only the part of a page that lies inside the file is written
+// back; stores past the end of the file do not extend it.
+//
+// Threads share their vmas; mm->lock protects them, and munmap()
+// holds the mm busy (mmbegin()) while it takes pages away.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "stat.h"
+#include "defs.h"
+
+// Map len bytes of f, from offset off, into the current
+// process. Returns the address of the mapping, or -1.
+uint64
+mmap(int len, int prot, int flags, struct file *f, int off)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  short type;
+
+  if(len <= 0 || off < 0 || off % PGSIZE != 0)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if((prot & ~(PROT_READ|PROT_WRITE)) != 0)
+    return -1;
+  if(f->type != FD_INODE || !f->readable)
+    return -1;
+  if(flags == MAP_SHARED && (prot & PROT_WRITE) && !f->writable)
+    return -1;
+  ilock(f->ip);
+  type = f->ip->type;
+  iunlock(f->ip);
+  if(type != T_FILE)
+    return -1;
+
+  // not into a range that munmap() is still clearing.
+  mmbegin(p);
+  acquire(&p->mm->lock);
+  if((v = vmaalloc(p, len)) == 0){
+    release(&p->mm->lock);
+    mmend(p);
+    return -1;
+  }
+  v->f = filedup(f);
+  v->off = off;
+  v->prot = prot;
+  v->flags = flags;
+  release(&p->mm->lock);
+  mmend(p);
+  return v->addr;
+}
+
+// Map the page at va of one of p's file mappings,
+// on the first access to it.
+// Returns 0, or -1 if va is in no file mapping, or past
+// the end of the file, or if out of memory.
+int
+mmapfault(struct proc *p, uint64 va)
+{
+  struct vma *v;
+  struct file *f;
+  struct inode *ip;
+  struct page *pg;
+  char *mem = 0;
+  pte_t *pte;
+  uint64 pa;
+  uint off;
+  int perm, flags, r;
+
+  // a copy in readi() or writei() holds the locks that filling
+  // the page needs, or ones taken before them: its inode's, a
+  // buffer's, the log. fileread() and filewrite() fault the
+  // pages in with mmapprefault() before taking them.
+  if(p->fscopy)
+    return -1;
+
+  va = PGROUNDDOWN(va);
+  acquire(&p->mm->lock);
+  if((v = vmalookup(p, va)) == 0 || v->f == 0 || v->prot == 0){
+    release(&p->mm->lock);
+    return -1;
+  }
+  // another thread may munmap() v while the page is read in.
+  f = filedup(v->f);
+  off = v->off + (va - v->addr);
+  flags = v->flags;
+  // there are no write-only pages.
+  perm = PTE_U | PTE_R | ((v->prot & PROT_WRITE) ? PTE_W : 0);
+  release(&p->mm->lock);
+  ip = f->ip;
+
+  ilock(ip);
+  pg = off < ip->size ? pcfill(ip, off) : 0;
+  iunlock(ip);
+  if(pg == 0){
+    fileclose(f);
+    return -1;
+  }
+
+  if(flags == MAP_SHARED){
+    // the mapping keeps pg's reference.
+    pa = pg->pa;
+  } else {
+    if((mem = kalloc()) != 0)
+      memmove(mem, (char*)pg->pa, PGSIZE);
+    pcput(pg);
+    if(mem == 0){
+      fileclose(f);
+      return -1;
+    }
+    pa = (uint64)mem;
+  }
+
+  // map the page, unless the mapping went away meanwhile,
+  // or another thread faulted the page in first.
+  r = -1;
+  acquire(&p->mm->lock);
+  v = vmalookup(p, va);
+  if(v && v->f == f && (pte = walk(p->pagetable, va, 1)) != 0){
+    if(*pte == 0){
+      *pte = PA2PTE(pa) | perm | PTE_V;
+      pa = 0;
+    }
+    r = 0;
+  }
+  release(&p->mm->lock);
+  fileclose(f);
+
+  if(pa){
+    if(flags == MAP_SHARED)
+      pcput(pg);
+    else
+      kfree(mem);
+  } else {
+    kvmsync(p->kpagetable, p->pagetable);
+  }
+  return r;
+}
+
+// Fault in the file pages among the n bytes at user address
+// addr, before a read() or write() takes the locks that would
+// keep mmapfault() from mapping them during the copy. Pages
+// that cannot be mapped are left for the copy to fail on.
+void
+mmapprefault(uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  uint64 a;
+
+  if(n <= 0 || addr + n <= MMAPBASE || addr + n < addr)
+    return;
+  if(addr < MMAPBASE)
+    addr = MMAPBASE;
+  for(a = PGROUNDDOWN(addr); a < addr + n && a < USERTOP; a += PGSIZE){
+    if((pte = walk(p->pagetable, a, 0)) != 0 && *pte != 0)
+      continue;
+    mmapfault(p, a);
+  }
+}
+
+// Write the page at pa, mapped at va by v, back to the file.
+static void
+mmapwrite(struct vma *v, uint64 va, uint64 pa)
+{
+  struct inode *ip = v->f->ip;
+  uint off = v->off + (va - v->addr);
+
+  begin_op();
+  ilock(ip);
+  if(off < ip->size)
+    writei(ip, 0, pa, off, ip->size - off < PGSIZE ? ip->size - off : PGSIZE);
+  iunlock(ip);
+  end_op();
+}
+
+// Unmap the pages of v in [va, va+len) from p, first
+// writing back those of a MAP_SHARED mapping that p
+// has written. v must already be out of p's vmas, or no
+// longer cover the range, so that nothing faults the
+// pages in again.
+// Called by p itself, or by fork() for a child
+// that has not run.
+static void
+mmapunmap(struct proc *p, struct vma *v, uint64 va, uint64 len)
+{
+  uint64 a, pa;
+  pte_t *pte;
+
+  // invalidate the PTEs, but keep the pages in them until
+  // no other thread can still be using one through its TLB.
+  for(a = va; a < va + len; a += PGSIZE)
+    if((pte = walk(p->pagetable, a, 0)) != 0 && (*pte & PTE_V))
+      *pte &= ~PTE_V;
+  uvmflush(p, va, len / PGSIZE);
+  mmquiesce(p);
+
+  for(a = va; a < va + len; a += PGSIZE){
+    if((pte = walk(p->pagetable, a, 0)) == 0 || *pte == 0)
+      continue;
+    pa = PTE2PA(*pte);
+    if(v->flags == MAP_SHARED){
+      if(*pte & PTE_D)
+        mmapwrite(v, a, pa);
+      pcunmap(pa);
+    } else {
+      kfree((void*)pa);
+    }
+    *pte = 0;
+  }
+}
+
+// Unmap [addr, addr+len) from the mapping that contains addr
+// in the current process. The range must be the whole mapping,
+// or start or end where it does. Returns 0, or -1.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v, old;
+
+  len = PGROUNDUP(len);
+  if(addr % PGSIZE != 0 || len == 0)
+    return -1;
+  mmbegin(p);
+  acquire(&p->mm->lock);
+  if((v = vmalookup(p, addr)) == 0 || v->f == 0 ||
+     addr + len < addr || addr + len > v->addr + v->len ||
+     (addr != v->addr && addr + len != v->addr + v->len)){
+    release(&p->mm->lock);
+    mmend(p);
+    return -1;
+  }
+  // take the range out of v before unmapping it,
+  // so that other threads cannot fault it back in.
+  old = *v;
+  if(len == v->len){
+    memset(v, 0, sizeof(*v));
+  } else if(addr == v->addr){
+    v->addr += len;
+    v->off += len;
+    v->len -= len;
+  } else {
+    v->len -= len;
+  }
+  release(&p->mm->lock);
+
+  mmapunmap(p, &old, addr, len);
+  if(len == old.len)
+    fileclose(old.f);
+  mmend(p);
+  return 0;
+}
+
+// Write back the pages that the current process has written
+// in its MAP_SHARED mappings of f's file. Everything else
+// written to a file is on disk once write() returns.
+// Returns 0, or -1 if f is not a file.
+int
+mmapsync(struct file *f)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  pte_t *pte;
+  uint64 a;
+
+  if(f->type != FD_INODE)
+    return -1;
+  // munmap() in another thread must not take v meanwhile.
+  mmbegin(p);
+  for(v = p->mm->vmas; v < &p->mm->vmas[NVMA]; v++){
+    if(v->addr == 0 || v->f == 0 || v->f->ip != f->ip || v->flags != MAP_SHARED)
+      continue;
+    for(a = v->addr; a < v->addr + v->len; a += PGSIZE){
+      pte = walk(p->pagetable, a, 0);
+      if(pte == 0 || (*pte & (PTE_V|PTE_D)) != (PTE_V|PTE_D))
+        continue;
+      // clear PTE_D first, so that a store during
+      // the write marks the page again.
+      *pte &= ~PTE_D;
+      uvmflush(p, a, 1);
+      mmapwrite(v, a, PTE2PA(*pte));
+    }
+  }
+  mmend(p);
+  return 0;
+}
+
+// Give child np p's file mappings, at the same addresses.
+// The pages of MAP_PRIVATE mappings are copied; those of
+// MAP_SHARED ones fault in from the page cache again.
+// Returns 0, or -1 if out of memory, in which case
+// munmapall(np) cleans up.
+int
+mmapfork(struct proc *p, struct proc *np)
+{
+  struct vma *v, *nv;
+  pte_t *pte;
+  uint64 a;
+  char *mem;
+
+  for(v = p->mm->vmas; v < &p->mm->vmas[NVMA]; v++){
+    if(v->addr == 0 || v->f == 0)
+      continue;
+    nv = &np->mm->vmas[v - p->mm->vmas];
+    *nv = *v;
+    filedup(nv->f);
+    if(v->flags == MAP_SHARED)
+      continue;
+    for(a = v->addr; a < v->addr + v->len; a += PGSIZE){
+      pte = walk(p->pagetable, a, 0);
+      if(pte == 0 || (*pte & PTE_V) == 0)
+        continue;
+      if((mem = kalloc()) == 0)
+        return -1;
+      memmove(mem, (char*)PTE2PA(*pte), PGSIZE);
+      if(mappages(np->pagetable, a, PGSIZE, (uint64)mem, PTE_FLAGS(*pte)) != 0){
+        kfree(mem);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// Write back and remove all of p's file mappings,
+// for exec() and exit(), or for a failed fork().
+void
+munmapall(struct proc *p)
+{
+  struct vma *v, old;
+
+  for(v = p->mm->vmas; v < &p->mm->vmas[NVMA]; v++){
+    if(v->addr == 0 || v->f == 0)
+      continue;
+    old = *v;
+    memset(v, 0, sizeof(*v));
+    mmapunmap(p, &old, old.addr, old.len);
+    fileclose(old.f);
+  }
+}
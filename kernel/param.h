@@ -1,4 +1,4 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      4096  // maximum number of processes
 
 #ifdef MLFQ
     #define NCPU          1  // maximum number of CPUs
@@ -13,9 +13,17 @@
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define MAXSPAWNACT  16  // max spawn() file actions
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NBUF         (MAXOPBLOCKS*3)  // initial size of disk block cache
+#define BUFMEM       16    // disk block cache grows to 1/BUFMEM of free memory
+#define READAHEAD    16    // most blocks readi() reads ahead of a sequential reader
 #define FSSIZE       2000  // size of file system in blocks
+#define SWAPBLOCKS   32768 // size of swap area after the file system, in blocks
 #define MAXPATH      128   // maximum file path name
 #define NQUEUE       5     // number of priority queues for MLFQ
+#define NSHM         16    // maximum number of shared-memory segments
+#define NVMA         16    // mappings above the heap, per process
+#define NPCACHE      128   // pages in the file page cache
+#define SLEEPSPIN    2000  // most tries acquiresleep() spins on a running holder
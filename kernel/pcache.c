@@ -0,0 +1,233 @@
+//
+// Page cache: whole pages of file data, for mmap().
+//
+// Each inode keeps a list of its cached pages, found by file
+// offset. A page read in by a fault on a file mapping stays
+// cached while the inode is in the inode table, so other
+// mappings of the file share it, and readi() and writei()
+// consult it so that read() and write() agree with what
+// MAP_SHARED mappings see. Pages that nothing references are
+// taken back, oldest first, when NPCACHE entries are in use or
+// memory runs out.
+//
+// pcache.lock protects the lists and the page entries.
+// Filling a page in needs the inode's lock, so that two
+// processes cannot read in the same page at once.
+//
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "defs.h"
+
+struct {
+  struct spinlock lock;
+  struct page page[NPCACHE];
+  int hand;       // where to look for a page to take back
+} pcache;
+
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+// Take pg off its inode's list.
+// Caller holds pcache.lock.
+static void
+pcunlink(struct page *pg)
+{
+  struct page **pp;
+
+  for(pp = &pg->ip->pages; *pp; pp = &(*pp)->next){
+    if(*pp == pg){
+      *pp = pg->next;
+      break;
+    }
+  }
+  pg->ip = 0;
+  pg->next = 0;
+}
+
+// Return an entry with a page that is on no list and has
+// one reference, or 0. Uses a free entry if there is one and
+// memory for it; otherwise takes back an unreferenced page.
+static struct page*
+pcalloc(void)
+{
+  struct page *pg;
+  void *mem;
+  int i;
+
+  mem = kalloc();
+  acquire(&pcache.lock);
+  if(mem){
+    for(pg = pcache.page; pg < &pcache.page[NPCACHE]; pg++){
+      if(pg->pa == 0){
+        pg->pa = (uint64)mem;
+        pg->ref = 1;
+        release(&pcache.lock);
+        return pg;
+      }
+    }
+  }
+  for(i = 0; i < NPCACHE; i++){
+    pg = &pcache.page[pcache.hand];
+    pcache.hand = (pcache.hand + 1) % NPCACHE;
+    if(pg->ip && pg->ref == 0){
+      pcunlink(pg);
+      pg->ref = 1;
+      release(&pcache.lock);
+      if(mem)
+        kfree(mem);
+      return pg;
+    }
+  }
+  release(&pcache.lock);
+  if(mem)
+    kfree(mem);
+  return 0;
+}
+
+// Return the cached page of ip at offset off (page-aligned),
+// with a reference the caller must drop with pcput(),
+// or 0 if the page is not cached.
+struct page*
+pcget(struct inode *ip, uint off)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(pg = ip->pages; pg; pg = pg->next){
+    if(pg->off == off){
+      pg->ref++;
+      break;
+    }
+  }
+  release(&pcache.lock);
+  return pg;
+}
+
+// Like pcget(), but read the page in if it is not cached.
+// Bytes past the end of the file read as zero.
+// Caller must hold ip->lock. Returns 0 if out of memory.
+struct page*
+pcfill(struct inode *ip, uint off)
+{
+  struct page *pg;
+  uint n;
+
+  if((pg = pcget(ip, off)) != 0)
+    return pg;
+  if((pg = pcalloc()) == 0)
+    return 0;
+
+  memset((void*)pg->pa, 0, PGSIZE);
+  if(off < ip->size){
+    n = ip->size - off < PGSIZE ? ip->size - off : PGSIZE;
+    if(readi(ip, 0, pg->pa, off, n) != n){
+      pcput(pg);
+      return 0;
+    }
+  }
+
+  acquire(&pcache.lock);
+  pg->ip = ip;
+  pg->off = off;
+  pg->next = ip->pages;
+  ip->pages = pg;
+  release(&pcache.lock);
+  return pg;
+}
+
+// Drop a reference to pg. A page that is no
+// longer cached is freed with its last reference.
+void
+pcput(struct page *pg)
+{
+  uint64 pa = 0;
+
+  acquire(&pcache.lock);
+  if(pg->ref < 1)
+    panic("pcput");
+  if(--pg->ref == 0 && pg->ip == 0){
+    pa = pg->pa;
+    pg->pa = 0;
+  }
+  release(&pcache.lock);
+  if(pa)
+    kfree((void*)pa);
+}
+
+// Drop the reference that a mapping holds on the
+// cached page at physical address pa.
+void
+pcunmap(uint64 pa)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.page; pg < &pcache.page[NPCACHE]; pg++)
+    if(pg->pa == pa)
+      break;
+  release(&pcache.lock);
+  if(pg == &pcache.page[NPCACHE])
+    panic("pcunmap");
+  pcput(pg);
+}
+
+// Free one cached page that nothing references, the next
+// past the hand, when memory runs low (swapkalloc()).
+// Returns 0, or -1 if every cached page is in use.
+int
+pcreclaim(void)
+{
+  struct page *pg;
+  uint64 pa;
+  int i;
+
+  acquire(&pcache.lock);
+  for(i = 0; i < NPCACHE; i++){
+    pg = &pcache.page[pcache.hand];
+    pcache.hand = (pcache.hand + 1) % NPCACHE;
+    if(pg->ip && pg->ref == 0){
+      pcunlink(pg);
+      pa = pg->pa;
+      pg->pa = 0;
+      release(&pcache.lock);
+      kfree((void*)pa);
+      return 0;
+    }
+  }
+  release(&pcache.lock);
+  return -1;
+}
+
+// Drop all of ip's cached pages, when its contents are
+// discarded or its inode-table entry is about to be reused.
+// Pages that are still mapped stay with their mappings,
+// and are freed when the last one goes.
+// Caller holds ip->lock, or the only reference to ip.
+void
+pcinval(struct inode *ip)
+{
+  struct page *pg;
+  uint64 pa;
+
+  acquire(&pcache.lock);
+  while((pg = ip->pages) != 0){
+    pcunlink(pg);
+    if(pg->ref == 0){
+      pa = pg->pa;
+      pg->pa = 0;
+      release(&pcache.lock);
+      kfree((void*)pa);
+      acquire(&pcache.lock);
+    }
+  }
+  release(&pcache.lock);
+}
@@ -17,6 +17,7 @@ struct pipe {
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int reading;    // a reader is copying bytes out
 };
 
 int
@@ -34,6 +35,7 @@ pipealloc(struct file **f0, struct file **f1)
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->reading = 0;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -73,31 +75,39 @@ pipeclose(struct pipe *pi, int writable)
     release(&pi->lock);
 }
 
+// the user's data is copied in and out in chunks of up to
+// PIPESIZE bytes with pi->lock released, since copyin() and
+// copyout() may sleep to read a swapped-out page back in.
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i = 0;
+  int i = 0, j, m;
   struct proc *pr = myproc();
+  char buf[PIPESIZE];
 
-  acquire(&pi->lock);
   while(i < n){
-    if(pi->readopen == 0 || killed(pr)){
-      release(&pi->lock);
-      return -1;
-    }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
-      sleep(&pi->nwrite, &pi->lock);
-    } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-        break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+    m = n - i;
+    if(m > PIPESIZE)
+      m = PIPESIZE;
+    if(copyin(pr->pagetable, buf, addr + i, m) == -1)
+      break;
+    acquire(&pi->lock);
+    for(j = 0; j < m; ){
+      if(pi->readopen == 0 || killed(pr)){
+        release(&pi->lock);
+        return -1;
+      }
+      if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
+        wakeup(&pi->nread);
+        sleep(&pi->nwrite, &pi->lock);
+      } else {
+        pi->data[pi->nwrite++ % PIPESIZE] = buf[j++];
+      }
     }
+    wakeup(&pi->nread);
+    release(&pi->lock);
+    i += m;
   }
-  wakeup(&pi->nread);
-  release(&pi->lock);
 
   return i;
 }
@@ -107,24 +117,34 @@ piperead(struct pipe *pi, uint64 addr, int n)
 {
   int i;
   struct proc *pr = myproc();
-  char ch;
+  char buf[PIPESIZE];
 
   acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
+  while((pi->nread == pi->nwrite && pi->writeopen) || pi->reading){  //DOC: pipe-empty
     if(killed(pr)){
       release(&pi->lock);
       return -1;
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+  for(i = 0; i < n && i < PIPESIZE; i++){  //DOC: piperead-copy
+    if(pi->nread + i == pi->nwrite)
       break;
+    buf[i] = pi->data[(pi->nread + i) % PIPESIZE];
   }
+  // consume the bytes only once they are in user memory, so
+  // that none are lost if copyout() fails. other readers wait
+  // meanwhile; writers cannot reach the bytes until nread moves.
+  pi->reading = 1;
+  release(&pi->lock);
+  if(i > 0 && copyout(pr->pagetable, addr, buf, i) == -1)
+    i = -1;
+  acquire(&pi->lock);
+  pi->reading = 0;
+  if(i > 0)
+    pi->nread += i;
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  wakeup(&pi->nread);
   release(&pi->lock);
   return i;
 }
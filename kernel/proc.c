@@ -5,31 +5,53 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "vdso.h"
+#include "event.h"
+#include "fcntl.h"
 #include "queue.h"
 
 uint64 sys_uptime();
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+#define NPIDHASH 256
+#define PIDHASH(pid) ((uint)(pid) % NPIDHASH)
+
+// Procs are allocated a page at a time, as they are needed,
+// up to NPROC, and are never freed: freeproc() puts them on a
+// free list to be reused. So a struct proc pointer stays
+// valid, and procs can be walked without a lock. The pid hash
+// is searched without a lock too (rcu.c), so a freed proc goes
+// on the free list, where its hashnext changes, only after a
+// grace period.
+struct proc *procs;             // every proc, linked by allnext
+int nproc;                      // how many there are
 
 struct proc *initproc;
 
+// pid_lock protects nextpid, changes to the pid hash,
+// the free list, and adding to procs.
 int nextpid = 1;
 struct spinlock pid_lock;
+static struct proc *pidhash[NPIDHASH];
+static struct proc *freeprocs;
+static struct proc **lastproc = &procs;
 
 extern void forkret(void);
+static void kthreadret(void);
 static void freeproc(struct proc *p);
+static void mmput(struct proc *p);
+static void mmclosefiles(struct mm *m);
+static void linkchild(struct proc *p, struct proc *c);
 
 extern char trampoline[]; // trampoline.S
+extern pagetable_t kernel_pagetable; // vm.c
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
-// memory model when using p->parent.
+// memory model when using p->parent,
+// p->children and p->sibling.
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
 uint64
 random(void)
 {
@@ -49,33 +71,81 @@ random(void)
   return (z1 ^ z2 ^ z3 ^ z4) / 2;
 }
 
+// user-only pages must not share addresses with the kernel
+// stacks, or their guard pages (memlayout.h).
+_Static_assert(THREADFRAME(0) + PGSIZE <= KSTACKBASE,
+               "thread frames overlap the kernel stacks");
+_Static_assert(VDSO + PGSIZE <= THREADFRAME(NPROC - 1) &&
+               VDSOPROC + PGSIZE <= VDSO && VDSOPROC >= USERTOP,
+               "vDSO pages overlap other mappings");
+
+// Make the page-table pages for every process's kernel
+// stack, high in memory, each followed by an invalid guard
+// page. allocproc() maps a stack when a proc is first used,
+// without needing memory for page tables, and since these
+// pages are shared by every kernel page table (kvmcreate()),
+// all of them see the new stack at once.
 void proc_mapstacks(pagetable_t kpgtbl)
 {
-  struct proc *p;
+  uint64 va;
 
-  for (p = proc; p < &proc[NPROC]; p++)
-  {
-    char *pa = kalloc();
-    if (pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int)(p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-  }
+  for (va = KSTACK(NPROC - 1); va < TRAMPOLINE; va += PGSIZE)
+    if (walk(kpgtbl, va, 1) == 0)
+      panic("proc_mapstacks");
 }
 
 // initialize the proc table.
 void procinit(void)
 {
-  struct proc *p;
-
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
-  for (p = proc; p < &proc[NPROC]; p++)
+}
+
+// Add a page of UNUSED procs to procs and to the free list.
+// Returns 0, or -1 if out of memory or there are NPROC already.
+static int
+procgrow(void)
+{
+  struct proc *p, *first;
+  char *mem;
+  int i, n;
+
+  if ((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  first = (struct proc *)mem;
+
+  acquire(&pid_lock);
+  n = PGSIZE / sizeof(struct proc);
+  if (n > NPROC - nproc)
+    n = NPROC - nproc;
+  for (i = n - 1; i >= 0; i--)
   {
+    p = &first[i];
     initlock(&p->lock, "proc");
     p->state = UNUSED;
-    p->kstack = KSTACK((int)(p - proc));
+    p->slot = nproc + i;
+    p->allnext = i + 1 < n ? &first[i + 1] : 0;
+    p->hashnext = freeprocs;
+    freeprocs = p;
   }
+  if (n > 0)
+  {
+    // procs is walked without a lock, so the new
+    // procs must be set up before they are on it.
+    __sync_synchronize();
+    *lastproc = first;
+    lastproc = &first[n - 1].allnext;
+    nproc += n;
+  }
+  release(&pid_lock);
+
+  if (n == 0)
+  {
+    kfree(mem);
+    return -1;
+  }
+  return 0;
 }
 
 // Must be called with interrupts disabled,
@@ -108,44 +178,151 @@ myproc(void)
   return p;
 }
 
-int allocpid()
+// Give p the next pid, and enter p in the pid hash.
+// p->lock must be held.
+int allocpid(struct proc *p)
 {
   int pid;
 
   acquire(&pid_lock);
   pid = nextpid;
   nextpid = nextpid + 1;
+  p->pid = pid;
+  p->hashnext = pidhash[PIDHASH(pid)];
+  rcuassign(pidhash[PIDHASH(pid)], p);
   release(&pid_lock);
 
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
+// Put p on the free list, once pidlookup()s that
+// might have been at p in the pid hash are done.
+static void
+pidfreed(void *arg)
+{
+  struct proc *p = arg;
+
+  acquire(&pid_lock);
+  p->hashnext = freeprocs;
+  freeprocs = p;
+  release(&pid_lock);
+}
+
+// Take p out of the pid hash, if it is in it,
+// and put it on the free list after a grace period.
+// p->lock must be held.
+static void
+pidfree(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&pid_lock);
+  for (pp = &pidhash[PIDHASH(p->pid)]; *pp; pp = &(*pp)->hashnext)
+  {
+    if (*pp == p)
+    {
+      *pp = p->hashnext;
+      break;
+    }
+  }
+  release(&pid_lock);
+  rcudefer(&p->rcu, pidfreed, p);
+}
+
+// Return the process with the given pid, with its
+// lock held, or 0 if there is none.
+static struct proc *
+pidlookup(int pid)
+{
+  struct proc *p;
+
+  rcureadlock();
+  for (p = rcuderef(pidhash[PIDHASH(pid)]); p; p = rcuderef(p->hashnext))
+    if (p->pid == pid)
+      break;
+  rcureadunlock();
+  if (p == 0)
+    return 0;
+
+  // p may have been freed since; pids are not reused.
+  acquire(&p->lock);
+  if (p->pid != pid || p->state == UNUSED)
+  {
+    release(&p->lock);
+    return 0;
+  }
+  return p;
+}
+
+// Allocate an mm, with one reference, for process pid.
+// Returns 0 if out of memory.
+static struct mm *
+mmalloc(int pid)
+{
+  struct mm *m;
+
+  if ((m = (struct mm *)kalloc()) == 0)
+    return 0;
+  memset(m, 0, sizeof(*m));
+  if ((m->vdsoproc = vdsoprocalloc(pid)) == 0)
+  {
+    kfree((void *)m);
+    return 0;
+  }
+  initlock(&m->lock, "mm");
+  m->ref = 1;
+  m->nlive = 1;
+  return m;
+}
+
+// Take an UNUSED proc off the free list, adding procs to
+// the table if there are none.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
+// The proc gets new, empty user memory, or if share is not 0,
+// becomes a thread sharing share's memory and files.
 // If there are no free procs, or a memory allocation fails, return 0.
 static struct proc *
-allocproc(void)
+allocproc(struct proc *share)
 {
   struct proc *p;
+  char *stack;
+  int r;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  acquire(&pid_lock);
+  while ((p = freeprocs) == 0)
   {
-    acquire(&p->lock);
-    if (p->state == UNUSED)
+    release(&pid_lock);
+    if (procgrow() < 0)
     {
-      goto found;
+      // there may be freed procs waiting out a grace period.
+      if (!rcupending())
+        return 0;
+      rcusync();
     }
-    else
+    acquire(&pid_lock);
+  }
+  freeprocs = p->hashnext;
+  p->hashnext = 0;
+  release(&pid_lock);
+
+  acquire(&p->lock);
+  if (p->kstack == 0)
+  {
+    // p's first use: map its kernel stack. The PTE
+    // has never been valid, so no TLB can hold it.
+    if ((stack = kalloc()) == 0)
     {
+      freeproc(p);
       release(&p->lock);
+      return 0;
     }
+    kvmmap(kernel_pagetable, KSTACK(p->slot), (uint64)stack, PGSIZE, PTE_R | PTE_W);
+    p->kstack = KSTACK(p->slot);
   }
-  return 0;
-
-found:
-  p->pid = allocpid();
+  allocpid(p);
   p->state = USED;
+  fpreset(p);
 
   // Allocate a trapframe page.
   ///////////////// IMPLEMENTED FOR SIGALARM /////////////////
@@ -163,13 +340,57 @@ found:
     return 0;
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
-  if (p->pagetable == 0)
+  if (share)
   {
-    freeproc(p);
-    release(&p->lock);
-    return 0;
+    // A thread: map its trapframe in the shared page
+    // table, at an address of its own.
+    p->trapframeva = THREADFRAME(p->slot);
+    acquire(&share->mm->lock);
+    r = mappages(share->pagetable, p->trapframeva, PGSIZE,
+                 (uint64)(p->trapframe), PTE_R | PTE_W);
+    if (r == 0)
+    {
+      share->mm->ref++;
+      share->mm->nlive++;
+    }
+    release(&share->mm->lock);
+    if (r != 0)
+    {
+      freeproc(p);
+      release(&p->lock);
+      return 0;
+    }
+    p->mm = share->mm;
+    p->pagetable = share->pagetable;
+    p->kpagetable = share->kpagetable;
+  }
+  else
+  {
+    if ((p->mm = mmalloc(p->pid)) == 0)
+    {
+      freeproc(p);
+      release(&p->lock);
+      return 0;
+    }
+
+    // An empty user page table.
+    p->trapframeva = TRAPFRAME;
+    p->pagetable = proc_pagetable(p);
+    if (p->pagetable == 0)
+    {
+      freeproc(p);
+      release(&p->lock);
+      return 0;
+    }
+
+    // The kernel page table to run p on.
+    p->kpagetable = kvmcreate();
+    if (p->kpagetable == 0)
+    {
+      freeproc(p);
+      release(&p->lock);
+      return 0;
+    }
   }
 
   // Set up new context to start executing at forkret,
@@ -203,7 +424,8 @@ found:
 }
 
 // free a proc structure and the data hanging from it,
-// including user pages.
+// including user pages, and put it on the free list.
+// p must be off its parent's list of children.
 // p->lock must be held.
 static void
 freeproc(struct proc *p)
@@ -214,13 +436,20 @@ freeproc(struct proc *p)
   if(p->trapframe_copy)   // freeing the allocated memory
     kfree((void*)p->trapframe_copy);
   /////////////////////////////////////////////////
+  if (p->mm)
+    mmput(p);
   p->trapframe = 0;
-  if (p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
+  p->mm = 0;
+  p->kpagetable = 0;
   p->pagetable = 0;
-  p->sz = 0;
+  p->trapframeva = 0;
+  p->ustack = 0;
+  p->kfn = 0;
+  pidfree(p);
   p->pid = 0;
   p->parent = 0;
+  p->children = 0;
+  p->sibling = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
@@ -235,10 +464,14 @@ freeproc(struct proc *p)
   p->sleep_time = 0;
   p->running_time = 0;
   p->proc_queue = 0;
+  p->nswapin = 0;
+  p->nswapout = 0;
+  p->pinned = 0;
+  p->fscopy = 0;
 }
 
 // Create a user page table for a given process, with no user memory,
-// but with trampoline and trapframe pages.
+// but with trampoline, trapframe and vDSO pages.
 pagetable_t
 proc_pagetable(struct proc *p)
 {
@@ -270,18 +503,67 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the vDSO pages, which user code reads.
+  if (vdsomap(pagetable, p->mm) < 0)
+  {
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
-// Free a process's page table, and free the
+// Free a process's page table, with its last thread's
+// trapframe mapped at trapframeva, and free the
 // physical memory it refers to.
-void proc_freepagetable(pagetable_t pagetable, uint64 sz)
+void proc_freepagetable(pagetable_t pagetable, uint64 sz, uint64 trapframeva)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
-  uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, trapframeva, 1, 0);
+  vdsounmap(pagetable);
   uvmfree(pagetable, sz);
 }
 
+// Drop p's reference to its mm, as p is freed, unmapping
+// p's trapframe. The last reference frees the page tables,
+// the user memory and the mm itself.
+// p->lock must be held.
+static void
+mmput(struct proc *p)
+{
+  struct mm *m = p->mm;
+  int last;
+
+  acquire(&m->lock);
+  last = m->ref == 1;
+  if (!last)
+  {
+    m->ref--;
+    if (p->pagetable)
+    {
+      uvmunmap(p->pagetable, p->trapframeva, 1, 0);
+      uvmflush(p, p->trapframeva, 1);
+    }
+  }
+  release(&m->lock);
+  if (!last)
+    return;
+
+  if (p->pagetable)
+  {
+    shmdetachall(p);
+    ringfree(p);
+  }
+  if (p->kpagetable)
+    kvmfree(p->kpagetable);
+  if (p->pagetable)
+    proc_freepagetable(p->pagetable, m->sz, p->trapframeva);
+  kfree((void *)m->vdsoproc);
+  kfree((void *)m);
+}
+
 // a user program that calls exec("/init")
 // assembled from ../user/initcode.S
 // od -t xC ../user/initcode
@@ -299,46 +581,64 @@ void userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(0);
   initproc = p;
 
   // allocate one user page and copy initcode's instructions
   // and data into it.
   uvmfirst(p->pagetable, initcode, sizeof(initcode));
-  p->sz = PGSIZE;
+  kvmsync(p->kpagetable, p->pagetable);
+  p->mm->sz = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;     // user program counter
   p->trapframe->sp = PGSIZE; // user stack pointer
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
+  p->mm->cwd = namei("/");
 
   p->state = RUNNABLE;
 
   release(&p->lock);
 }
 
-// Grow or shrink user memory by n bytes.
-// Return 0 on success, -1 on failure.
-int growproc(int n)
+// Grow or shrink user memory by n bytes, storing
+// the old size at *oldszp, read while no other thread
+// can change it. Return 0 on success, -1 on failure.
+int growproc(int n, uint64 *oldszp)
 {
-  uint64 sz;
+  uint64 sz, oldsz;
   struct proc *p = myproc();
+  void *freed = 0;
 
-  sz = p->sz;
+  mmbegin(p);
+  sz = oldsz = *oldszp = p->mm->sz;
   if (n > 0)
   {
     if ((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0)
     {
+      mmend(p);
       return -1;
     }
   }
   else if (n < 0)
   {
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    freed = uvmshrink(p->pagetable, sz, sz + n);
+    sz = sz + n;
   }
-  p->sz = sz;
+  kvmsync(p->kpagetable, p->pagetable);
+  p->mm->sz = sz;
+
+  // the TLB may hold stale entries for the pages
+  // just mapped or unmapped under p's ASID.
+  if (sz > oldsz)
+    uvmflush(p, PGROUNDUP(oldsz), (PGROUNDUP(sz) - PGROUNDUP(oldsz)) / PGSIZE);
+  else
+    uvmflush(p, PGROUNDUP(sz), (PGROUNDUP(oldsz) - PGROUNDUP(sz)) / PGSIZE);
+  if (freed)
+    mmquiesce(p);
+  kfreechain(freed);
+  mmend(p);
   return 0;
 }
 
@@ -351,31 +651,54 @@ int fork(void)
   struct proc *p = myproc();
 
   // Allocate process.
-  if ((np = allocproc()) == 0)
+  if ((np = allocproc(0)) == 0)
+  {
+    return -1;
+  }
+
+  // Copy user memory from parent to child, keeping p's
+  // other threads from changing it meanwhile.
+  // uvmcopy() may sleep for swapping, so np->lock cannot
+  // be held; np is still USED, so nothing else looks at it.
+  release(&np->lock);
+  mmbegin(p);
+  if (uvmcopy(p->pagetable, np->pagetable, p->mm->sz) < 0)
   {
+    mmend(p);
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
     return -1;
   }
+  np->mm->sz = p->mm->sz;
+  np->mm->guard = p->mm->guard;
 
-  // Copy user memory from parent to child.
-  if (uvmcopy(p->pagetable, np->pagetable, p->sz) < 0)
+  // Attach the parent's shared-memory segments and files.
+  if (shmfork(p, np) < 0 || mmapfork(p, np) < 0)
   {
+    mmend(p);
+    munmapall(np);
+    acquire(&np->lock);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
-  np->sz = p->sz;
+  mmend(p);
+  acquire(&np->lock);
+  kvmsync(np->kpagetable, np->pagetable);
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
+  fpfork(p, np);
 
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
 
   // increment reference counts on open file descriptors.
   for (i = 0; i < NOFILE; i++)
-    if (p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+    if (p->mm->ofile[i])
+      np->mm->ofile[i] = filedup(p->mm->ofile[i]);
+  np->mm->cwd = idup(p->mm->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -384,7 +707,7 @@ int fork(void)
   release(&np->lock);
 
   acquire(&wait_lock);
-  np->parent = p;
+  linkchild(p, np);
   release(&wait_lock);
 
   acquire(&np->lock);
@@ -400,47 +723,264 @@ int fork(void)
   return pid;
 }
 
+// Close all of m's open files, and let go of its cwd.
+static void
+mmclosefiles(struct mm *m)
+{
+  for (int fd = 0; fd < NOFILE; fd++)
+  {
+    if (m->ofile[fd])
+    {
+      struct file *f = m->ofile[fd];
+      fileclose(f);
+      m->ofile[fd] = 0;
+    }
+  }
+
+  if (m->cwd)
+  {
+    begin_op();
+    iput(m->cwd);
+    end_op();
+    m->cwd = 0;
+  }
+}
+
+// Apply spawn() file actions to np's open files.
+// Returns 0, or -1 if an action names a closed descriptor.
+static int
+spawnactions(struct proc *np, struct spawnaction *acts, int nacts)
+{
+  struct file **ofile = np->mm->ofile;
+  struct spawnaction *a;
+
+  for (a = acts; a < &acts[nacts]; a++)
+  {
+    if (a->fd < 0 || a->fd >= NOFILE || ofile[a->fd] == 0)
+      return -1;
+    if (a->op == SPAWN_DUP2)
+    {
+      if (a->newfd < 0 || a->newfd >= NOFILE)
+        return -1;
+      if (a->newfd == a->fd)
+        continue;
+      if (ofile[a->newfd])
+        fileclose(ofile[a->newfd]);
+      ofile[a->newfd] = filedup(ofile[a->fd]);
+    }
+    else if (a->op == SPAWN_CLOSE)
+    {
+      fileclose(ofile[a->fd]);
+      ofile[a->fd] = 0;
+    }
+    else
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Create a child that runs the program in path with argv,
+// as fork() followed by exec() in the child would, but
+// without copying the caller's memory only to discard it.
+// The child gets the caller's open files, changed by the
+// nacts file actions in acts. Returns the child's pid, or -1.
+int spawn(char *path, char **argv, struct spawnaction *acts, int nacts)
+{
+  int i, pid, argc;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  // Allocate process.
+  if ((np = allocproc(0)) == 0)
+  {
+    return -1;
+  }
+
+  // kexec() may sleep, so np->lock cannot be held;
+  // np is still USED, so nothing else looks at it.
+  release(&np->lock);
+
+  acquire(&p->mm->lock);
+  for (i = 0; i < NOFILE; i++)
+    if (p->mm->ofile[i])
+      np->mm->ofile[i] = filedup(p->mm->ofile[i]);
+  np->mm->cwd = idup(p->mm->cwd);
+  release(&p->mm->lock);
+
+  if (spawnactions(np, acts, nacts) < 0 || (argc = kexec(np, path, argv)) < 0)
+  {
+    mmclosefiles(np->mm);
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  // main(argc, argv)
+  np->trapframe->a0 = argc;
+
+  pid = np->pid;
+
+  acquire(&wait_lock);
+  linkchild(p, np);
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  release(&np->lock);
+  np->strace_bit = p->strace_bit;
+  np->birth_time = p->birth_time;
+  np->num_tickets = p->num_tickets;
+  np->static_priority = p->static_priority;
+  np->dynamic_priority = p->dynamic_priority;
+  return pid;
+}
+
+// Make c a child of p.
+// Caller must hold wait_lock.
+static void
+linkchild(struct proc *p, struct proc *c)
+{
+  c->parent = p;
+  c->sibling = p->children;
+  p->children = c;
+}
+
+// Take c, which is about to be freed, off its
+// parent's list of children.
+// Caller must hold wait_lock.
+static void
+unlinkchild(struct proc *c)
+{
+  struct proc **pp;
+
+  for (pp = &c->parent->children; *pp; pp = &(*pp)->sibling)
+  {
+    if (*pp == c)
+    {
+      *pp = c->sibling;
+      break;
+    }
+  }
+  c->sibling = 0;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void reparent(struct proc *p)
 {
-  struct proc *pp;
+  struct proc *pp, *last = 0;
 
-  for (pp = proc; pp < &proc[NPROC]; pp++)
+  for (pp = p->children; pp; pp = pp->sibling)
   {
-    if (pp->parent == p)
+    pp->parent = initproc;
+    last = pp;
+  }
+  if (last)
+  {
+    last->sibling = initproc->children;
+    initproc->children = p->children;
+    p->children = 0;
+    wakeup(initproc);
+  }
+}
+
+// Kill the other threads made by clone() that share p's
+// memory, as kill() would, and wait for those that p made
+// to exit, reaping them. Threads made by p's threads pass
+// to init, which reaps them, as their parents exit.
+static void exitthreads(struct proc *p)
+{
+  struct proc *q;
+  int havekids;
+
+  for (q = procs; q; q = q->allnext)
+  {
+    if (q == p)
+      continue;
+    acquire(&q->lock);
+    if (q->mm == p->mm && q->kfn == 0 && q->state != ZOMBIE)
+    {
+      q->killed = 1;
+      if (q->state == SLEEPING)
+        q->state = RUNNABLE;
+    }
+    release(&q->lock);
+  }
+
+  acquire(&wait_lock);
+  for (;;)
+  {
+    havekids = 0;
+    for (q = p->children; q; q = q->sibling)
     {
-      pp->parent = initproc;
-      wakeup(initproc);
+      if (q->mm != p->mm || q->kfn)
+        continue;
+      havekids = 1;
+      acquire(&q->lock);
+      if (q->state == ZOMBIE)
+      {
+        unlinkchild(q);
+        freeproc(q);
+        release(&q->lock);
+        break;
+      }
+      release(&q->lock);
     }
+    if (!havekids)
+      break;
+    // the list changed if one was reaped; look again.
+    if (q == 0)
+      sleep(p, &wait_lock);
   }
+  release(&wait_lock);
 }
 
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait().
+// If p is a process's main thread, its other threads exit too.
 void exit(int status)
 {
   struct proc *p = myproc();
+  struct mm *m = p->mm;
+  int last, onlyk;
 
   if (p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for (int fd = 0; fd < NOFILE; fd++)
+  if (p->trapframeva == TRAPFRAME && p->mm->ref > 1)
+    exitthreads(p);
+
+  traceexit(status);
+
+  // The files and mappings are shared with p's threads,
+  // so only the last thread to exit lets go of them.
+  // Kernel threads exit before the last other one does,
+  // which waits for them in ringstop().
+  acquire(&m->lock);
+  onlyk = p->kfn == 0 && m->nkthread > 0 && m->nlive == m->nkthread + 1;
+  release(&m->lock);
+  if (onlyk)
+    ringstop(m);
+  acquire(&m->lock);
+  last = --m->nlive == 0;
+  if (p->kfn)
+    m->nkthread--;
+  release(&m->lock);
+  if (p->kfn)
+    wakeup(&m->nkthread);
+  if (last)
   {
-    if (p->ofile[fd])
-    {
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
-  }
+    // Write back and unmap mapped files.
+    munmapall(p);
 
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
+    mmclosefiles(m);
+
+    // Detach shared memory.
+    shmdetachall(p);
+  }
 
   acquire(&wait_lock);
 
@@ -470,18 +1010,19 @@ void exit(int status)
 int wait(uint64 addr)
 {
   struct proc *pp;
-  int havekids, pid;
+  int havekids, pid, xstate;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
 
   for (;;)
   {
-    // Scan through table looking for exited children.
+    // Scan through p's children looking for exited ones.
     havekids = 0;
-    for (pp = proc; pp < &proc[NPROC]; pp++)
+    for (pp = p->children; pp; pp = pp->sibling)
     {
-      if (pp->parent == p)
+      // threads are reaped by join().
+      if (pp->mm != p->mm)
       {
         // make sure the child isn't still in exit() or swtch().
         acquire(&pp->lock);
@@ -491,16 +1032,16 @@ int wait(uint64 addr)
         {
           // Found one.
           pid = pp->pid;
-          if (addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                   sizeof(pp->xstate)) < 0)
-          {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
+          xstate = pp->xstate;
+          unlinkchild(pp);
           freeproc(pp);
           release(&pp->lock);
           release(&wait_lock);
+          // copy out with no locks held; copyout may
+          // sleep to read a swapped-out page back in.
+          if (addr != 0 && copyout(p->pagetable, addr, (char *)&xstate,
+                                   sizeof(xstate)) < 0)
+            return -1;
           return pid;
         }
         release(&pp->lock);
@@ -519,12 +1060,200 @@ int wait(uint64 addr)
   }
 }
 
+// Create a thread that shares p's memory and open files,
+// and starts in fn(arg) on the user stack whose top is stack.
+// Returns the new thread's pid, or -1.
+int clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  struct proc *np;
+  struct proc *p = myproc();
+  int pid;
+
+  if (stack % 16 != 0)
+    return -1;
+
+  if ((np = allocproc(p)) == 0)
+    return -1;
+
+  // one VDSOPROC page cannot hold each thread's pid, so
+  // getpid() in ulib.c makes the system call from now on.
+  p->mm->vdsoproc->pid = 0;
+
+  *(np->trapframe) = *(p->trapframe);
+  fpfork(p, np);
+  np->trapframe->epc = fn;
+  np->trapframe->sp = stack;
+  np->trapframe->a0 = arg;
+  // fn must call exit() rather than return.
+  np->trapframe->ra = -1;
+  np->ustack = stack;
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  pid = np->pid;
+
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  linkchild(p, np);
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  release(&np->lock);
+  np->strace_bit = p->strace_bit;
+  np->birth_time = p->birth_time;
+  np->num_tickets = p->num_tickets;
+  np->static_priority = p->static_priority;
+  np->dynamic_priority = p->dynamic_priority;
+  return pid;
+}
+
+// Create a thread of the current process that runs fn in the
+// kernel and never returns to user space; fn must call exit().
+// Returns the thread's pid, or -1.
+int kthread(void (*fn)(void))
+{
+  struct proc *np;
+  struct proc *p = myproc();
+  int pid;
+
+  if ((np = allocproc(p)) == 0)
+    return -1;
+
+  np->kfn = fn;
+  np->context.ra = (uint64)kthreadret;
+  safestrcpy(np->name, p->name, sizeof(p->name));
+  pid = np->pid;
+  acquire(&p->mm->lock);
+  p->mm->nkthread++;
+  release(&p->mm->lock);
+
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  linkchild(p, np);
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  release(&np->lock);
+  return pid;
+}
+
+// Wait for a thread made by this process's clone() to exit,
+// and return its pid. Stores the stack it was given at addr,
+// so the caller can free it. Return -1 if there are none.
+int join(uint64 addr)
+{
+  struct proc *pp;
+  int havekids, pid;
+  uint64 ustack;
+  struct proc *p = myproc();
+
+  acquire(&wait_lock);
+
+  for (;;)
+  {
+    havekids = 0;
+    for (pp = p->children; pp; pp = pp->sibling)
+    {
+      // kernel threads only exit after p has (see exit()),
+      // and are left for init to reap.
+      if (pp->mm == p->mm && pp->kfn == 0)
+      {
+        acquire(&pp->lock);
+
+        havekids = 1;
+        if (pp->state == ZOMBIE)
+        {
+          pid = pp->pid;
+          ustack = pp->ustack;
+          unlinkchild(pp);
+          freeproc(pp);
+          release(&pp->lock);
+          release(&wait_lock);
+          if (addr != 0 && copyout(p->pagetable, addr, (char *)&ustack,
+                                   sizeof(ustack)) < 0)
+            return -1;
+          return pid;
+        }
+        release(&pp->lock);
+      }
+    }
+
+    if (!havekids || killed(p))
+    {
+      release(&wait_lock);
+      return -1;
+    }
+
+    sleep(p, &wait_lock);
+  }
+}
+
+// Keep p's other threads from changing the address space
+// (growproc(), mmap(), munmap(), shmat(), shmdt()) until
+// mmend(). May sleep; must not be held across ilock().
+void mmbegin(struct proc *p)
+{
+  struct mm *m = p->mm;
+
+  acquire(&m->lock);
+  while (m->busy)
+    sleep(m, &m->lock);
+  m->busy = 1;
+  release(&m->lock);
+}
+
+void mmend(struct proc *p)
+{
+  struct mm *m = p->mm;
+
+  acquire(&m->lock);
+  m->busy = 0;
+  wakeup(m);
+  release(&m->lock);
+}
+
+// After uvmflush() has given up p's ASID, wait until each of
+// p's other threads that is running on a hart has been through
+// sched() or back to user space with a fresh ASID (usertrapret()),
+// and so may no longer use stale TLB entries, before the pages
+// they map are freed. The timer interrupt brings a thread that
+// runs in user space back through usertrapret() within a tick,
+// even under FCFS and PBS, which do not preempt it. There are no
+// cross-hart TLB shootdowns. Must not hold any spinlock.
+void mmquiesce(struct proc *p)
+{
+  struct proc *q;
+  uint64 n;
+
+  if (p->mm->ref == 1)
+    return;
+  for (q = procs; q; q = q->allnext)
+  {
+    if (q == p || q->mm != p->mm)
+      continue;
+    acquire(&q->lock);
+    n = __atomic_load_n(&q->nsched, __ATOMIC_ACQUIRE);
+    while (q->state == RUNNING && __atomic_load_n(&q->nsched, __ATOMIC_ACQUIRE) == n &&
+           q->mm == p->mm)
+    {
+      release(&q->lock);
+      yield();
+      acquire(&q->lock);
+    }
+    release(&q->lock);
+  }
+}
+
 ///////////////////////// SCHEDULERS ////////////////////////////////
 /////////////////////// ROUND ROBIN - original implementation //////////////
 void roundRobin(struct cpu *c)
 {
   struct proc *p;
-  for (p = proc; p < &proc[NPROC]; p++)
+  for (p = procs; p; p = p->allnext)
   {
     acquire(&p->lock);
     if (p->state == RUNNABLE)
@@ -553,9 +1282,8 @@ void fcfs(struct cpu *c)
   struct proc *oldestproc = 0;
   uint64 oldesttime = 0;
 
-  for (int i = 0; i < NPROC; i++)
+  for (struct proc *p = procs; p; p = p->allnext)
   {
-    struct proc *p = &proc[i];
     acquire(&p->lock);
 
     if (oldestproc)
@@ -605,9 +1333,8 @@ void lotteryBased(struct cpu *c)
 {
   uint64 totalNumTickets = 0, ticketCnt = 0;
 
-  for (int i = 0; i < NPROC; i++)
+  for (struct proc *p = procs; p; p = p->allnext)
   {
-    struct proc *p = &proc[i];
     acquire(&p->lock);
 
     if (p->state == RUNNABLE)
@@ -619,9 +1346,8 @@ void lotteryBased(struct cpu *c)
   struct proc *chosenproc = 0;
   uint64 randNum = random() % totalNumTickets;
 
-  for (int i = 0; i < NPROC; i++)
+  for (struct proc *p = procs; p; p = p->allnext)
   {
-    struct proc *p = &proc[i];
     acquire(&p->lock);
 
     if (p->state != RUNNABLE)
@@ -670,9 +1396,8 @@ void priority_based(struct cpu *c)
 {
   struct proc *chosenproc = 0;
 
-  for (int i = 0; i < NPROC; i++)
+  for (struct proc *p = procs; p; p = p->allnext)
   {
-    struct proc *p = &proc[i];
     acquire(&p->lock);
     if (p->state != RUNNABLE)
     {
@@ -775,6 +1500,9 @@ void scheduler(void)
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
+    // No RCU reader can be on this hart here.
+    rcuquiesce(c);
+
 #ifdef RR
     roundRobin(c);
 #endif
@@ -816,7 +1544,15 @@ void sched(void)
     panic("sched interruptible");
 
   intena = mycpu()->intena;
+  // p's kernel page table may be freed before p runs
+  // again, or p may next run on another hart.
+  kvmdeactivate();
+  fpswitch(p);
+  p->nsched++;
+  TRACEPOINT(EVC_SCHED, EV_SWITCHOUT, p->state, 0);
   swtch(&p->context, &mycpu()->context);
+  TRACEPOINT(EVC_SCHED, EV_SWITCHIN, 0, 0);
+  kvmactivate(p);
   mycpu()->intena = intena;
 }
 
@@ -837,6 +1573,8 @@ void forkret(void)
   static int first = 1;
 
   // Still holding p->lock from scheduler.
+  TRACEPOINT(EVC_SCHED, EV_SWITCHIN, 0, 0);
+  kvmactivate(myproc());
   release(&myproc()->lock);
 
   if (first)
@@ -851,6 +1589,22 @@ void forkret(void)
   usertrapret();
 }
 
+// A kthread()'s very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  TRACEPOINT(EVC_SCHED, EV_SWITCHIN, 0, 0);
+  kvmactivate(p);
+  release(&p->lock);
+
+  p->kfn();
+  panic("kthreadret");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void sleep(void *chan, struct spinlock *lk)
@@ -889,7 +1643,7 @@ void wakeup(void *chan)
 {
   struct proc *p;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  for (p = procs; p; p = p->allnext)
   {
     if (p != myproc())
     {
@@ -897,6 +1651,7 @@ void wakeup(void *chan)
       if (p->state == SLEEPING && p->chan == chan)
       {
         p->state = RUNNABLE;
+        TRACEPOINT(EVC_WAKEUP, EV_WAKEUP, p->pid, (uint64)chan);
 
         if (p->sleep_start != 0)                         // added for PBS
           p->sleep_time = sys_uptime() - p->sleep_start; // added for PBS
@@ -914,23 +1669,16 @@ int kill(int pid)
 {
   struct proc *p;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  if ((p = pidlookup(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if (p->state == SLEEPING)
   {
-    acquire(&p->lock);
-    if (p->pid == pid)
-    {
-      p->killed = 1;
-      if (p->state == SLEEPING)
-      {
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+    // Wake process from sleep().
+    p->state = RUNNABLE;
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 void setkilled(struct proc *p)
@@ -956,9 +1704,15 @@ int killed(struct proc *p)
 int either_copyout(int user_dst, uint64 dst, void *src, uint64 len)
 {
   struct proc *p = myproc();
+  int r;
   if (user_dst)
   {
-    return copyout(p->pagetable, dst, src, len);
+    // the caller may hold inode, buffer and log locks,
+    // so the copy must not fault in file pages (mmapfault()).
+    p->fscopy = 1;
+    r = copyout(p->pagetable, dst, src, len);
+    p->fscopy = 0;
+    return r;
   }
   else
   {
@@ -973,9 +1727,15 @@ int either_copyout(int user_dst, uint64 dst, void *src, uint64 len)
 int either_copyin(void *dst, int user_src, uint64 src, uint64 len)
 {
   struct proc *p = myproc();
+  int r;
   if (user_src)
   {
-    return copyin(p->pagetable, dst, src, len);
+    // the caller may hold inode, buffer and log locks,
+    // so the copy must not fault in file pages (mmapfault()).
+    p->fscopy = 1;
+    r = copyin(p->pagetable, dst, src, len);
+    p->fscopy = 0;
+    return r;
   }
   else
   {
@@ -998,9 +1758,10 @@ void procdump(void)
       [ZOMBIE] "zombie"};
   struct proc *p;
   char *state;
+  int resident, swapped;
 
   printf("\n");
-  for (p = proc; p < &proc[NPROC]; p++)
+  for (p = procs; p; p = p->allnext)
   {
     if (p->state == UNUSED)
       continue;
@@ -1009,6 +1770,12 @@ void procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    if (p->pagetable && p->state != RUNNING)
+    {
+      uvmcount(p->pagetable, p->mm->sz, &resident, &swapped);
+      printf(" rss=%d swapped=%d in=%d out=%d", resident, swapped,
+             (int)p->nswapin, (int)p->nswapout);
+    }
     printf("\n");
   }
 }
@@ -1052,18 +1819,7 @@ int calcDP(struct proc *p)
 
 int set_priority(int new_priority, int pid)
 {
-  struct proc *chosen = 0;
-  for (int i = 0; i < NPROC; i++)
-  {
-    struct proc *p = &proc[i];
-    acquire(&p->lock);
-    if (pid == p->pid)
-    {
-      chosen = p;
-      break;
-    }
-    release(&p->lock);
-  }
+  struct proc *chosen = pidlookup(pid);
 
   int prevSP = -1;
   if (chosen)
@@ -1103,6 +1859,8 @@ uint64 sys_sigalarm(void)
   myproc()->num_ticks = this_ticks;
   myproc()->curr_ticks = 0;
   myproc()->sig_handler = handler;
+  // rearm, also from a handler that won't sigreturn().
+  myproc()->alarm_is_set = 0;
   return 0; 
 }
 //////////////////////////////////////////////
@@ -1112,16 +1870,16 @@ int
 waitx(uint64 addr, uint* wtime, uint* rtime)
 {
   struct proc *np;
-  int havekids, pid;
+  int havekids, pid, xstate;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through p's children looking for exited ones.
     havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      if(np->parent == p){
+    for(np = p->children; np; np = np->sibling){
+      if(np->mm != p->mm){
         // make sure the child isn't still in exit() or swtch().
         acquire(&np->lock);
 
@@ -1131,15 +1889,14 @@ waitx(uint64 addr, uint* wtime, uint* rtime)
           pid = np->pid;
           *rtime = np->rtime;
           *wtime = np->etime - np->ctime - np->rtime;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
+          xstate = np->xstate;
+          unlinkchild(np);
           freeproc(np);
           release(&np->lock);
           release(&wait_lock);
+          if(addr != 0 && copyout(p->pagetable, addr, (char *)&xstate,
+                                  sizeof(xstate)) < 0)
+            return -1;
           return pid;
         }
         release(&np->lock);
@@ -1162,7 +1919,7 @@ void
 update_time()
 {
   struct proc* p;
-  for (p = proc; p < &proc[NPROC]; p++) {
+  for (p = procs; p; p = p->allnext) {
     acquire(&p->lock);
     if (p->state == RUNNING) {
       p->rtime++;
@@ -24,6 +24,9 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 asidgen;             // ASID generation this hart's TLB was flushed for.
+  struct proc *fpproc;        // The process whose FP registers this hart may hold (fp.c).
+  uint64 rcuqs;               // Passes through scheduler(), for RCU (rcu.c).
 };
 
 extern struct cpu cpus[NCPU];
@@ -79,8 +82,47 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// A process's floating-point registers, saved
+// while they are not loaded in a hart (fp.c).
+struct fpstate {
+  uint64 f[32];
+  uint64 fcsr;
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A mapping of p's, between MMAPBASE and USERTOP.
+struct vma {
+  uint64 addr;                 // First address; 0 if the slot is free
+  uint64 len;                  // Length in bytes, page-aligned
+  struct shmseg *shm;          // Shared-memory segment mapped here (shm.c)
+  struct file *f;              // File mapped here (mmap.c)
+  uint off;                    // Offset in f of addr
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_SHARED or MAP_PRIVATE
+};
+
+// The user memory and open files of a process, which
+// its threads (made by clone()) share. The page tables
+// themselves are reached through each thread's proc.
+struct mm {
+  struct spinlock lock;        // protects ref, nlive, nkthread and busy
+  int ref;                     // Threads not yet freed
+  int nlive;                   // Threads not yet exited
+  int busy;                    // A thread is changing the mappings (mmbegin())
+  int nkthread;                // Of nlive, threads made by kthread()
+
+  uint64 sz;                   // Size of process memory (bytes)
+  uint64 guard;                // User stack guard page, if not 0 (exec.c)
+  uint64 asid;                 // TLB tag for pagetable, with its generation (vm.c)
+  uint64 tlbharts;             // Harts that may cache translations for asid
+  struct vma vmas[NVMA];       // Mappings above the heap
+  struct file *ofile[NOFILE];  // Open files
+  struct inode *cwd;           // Current directory
+  struct ring *ring;           // Syscall ring, if any (ring.c)
+  struct vdsoproc *vdsoproc;   // Mapped at VDSOPROC (vdso.c)
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -92,20 +134,40 @@ struct proc {
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
 
-  // wait_lock must be held when using this:
+  // wait_lock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *children;       // First child
+  struct proc *sibling;        // Next child of parent
+
+  // pid_lock must be held to change this; pidlookup()
+  // follows it without, under rcureadlock():
+  struct proc *hashnext;       // Next in pid hash chain, or free list
+  struct rcuhead rcu;          // Puts it on the free list, once freed
+
+  // set once, when the proc is first allocated.
+  struct proc *allnext;        // Next in the list of all procs
+  int slot;                    // Index for KSTACK() and THREADFRAME()
 
   // these are private to the process, so p->lock need not be held.
-  uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
+  uint64 kstack;               // Virtual address of kernel stack; 0 until first used
   uint64 processMask;          // Mask bits for syscall "strace"
-  pagetable_t pagetable;       // User page table
+  struct mm *mm;               // Memory and files, shared with p's threads
+  pagetable_t pagetable;       // User page table, p->mm's
+  pagetable_t kpagetable;      // Kernel page table, showing user memory too (vm.c)
+  uint64 nswapin;              // Pages read back in from swap (swap.c)
+  uint64 nswapout;             // Pages written out to swap
+  int pinned;                  // If not 0, swap.c leaves p's pages alone (uvmpin())
+  int fscopy;                  // In either_copyin/out(), perhaps holding FS locks
   struct trapframe *trapframe; // data page for trampoline.S
+  uint64 trapframeva;          // where pagetable maps trapframe
+  uint64 nsched;               // Times p has given up its hart, or returned to user space
+  uint64 ustack;               // User stack given to clone(), for join()
+  void (*kfn)(void);           // If not 0, made by kthread() to run this
+  struct fpstate fpstate;      // FP registers, as last saved
+  int fpcpu;                   // Hart whose FP registers are p's, or -1
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-  uint32 strace_bit;           // stores the mask when strace is invoked
+  uint64 strace_bit;           // stores the mask when strace is invoked
   uint64 birth_time;           // stores the time of invocation of the process, (for FCFS)
   uint64 num_tickets;          // stores the number of tickets allocated to the process (LBS)
   uint16 static_priority;      // stores the static priority of a proc. For PBS
@@ -122,6 +184,7 @@ struct proc {
   /////////////////// IMPLEMENTED FOR SIGALARM ///////////////
   struct trapframe* trapframe_copy;   // stores trapframe as signal is sent
   // This ensures that the value of the registers are stored when alarm occurs
+  struct fpstate fpstate_copy;        // and the FP registers (fpsave())
 
   uint32 curr_ticks;            // stores the number of ticks passed
   uint64 sig_handler;           // stores the funciton pointer
@@ -0,0 +1,152 @@
+//
+// Sampling profiler.
+//
+// While profile() has it on, every hart's timer interrupt (see
+// devintr()) counts the pc it interrupted, in the kernel or in
+// user space, and the running pid, in a hash table of this
+// CPU's, with interrupts off and no lock. Turning it on starts
+// a new generation, and each CPU empties its table when it
+// first sees the new one. Reading the profile device returns
+// the entries of the current generation, and then 0, until
+// profile() turns it on again.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "defs.h"
+#include "prof.h"
+
+#define NPROFENT 512  // entries in each CPU's table
+#define NPROBE   16   // most slots a sample may look at
+
+struct proftab {
+  uint gen;           // the generation the entries are for
+  uint dropped;
+  struct profent ent[NPROFENT];
+};
+
+static struct proftab proftabs[NCPU];
+static volatile int profon;
+static volatile uint profgen;
+
+static struct {
+  struct sleeplock lock;
+  int cpu;            // where the next read starts
+  int i;
+} profrd;
+
+// Count a sample of pc on this CPU. Called from
+// devintr() with interrupts off, on every hart.
+void
+profsample(uint64 pc)
+{
+  struct proftab *t;
+  struct profent *e;
+  struct proc *p;
+  int pid, i, h;
+
+  if(__builtin_expect(!profon, 1))
+    return;
+
+  t = &proftabs[cpuid()];
+  if(t->gen != profgen){
+    memset(t->ent, 0, sizeof(t->ent));
+    t->dropped = 0;
+    t->gen = profgen;
+  }
+  p = mycpu()->proc;
+  pid = p ? p->pid : 0;
+
+  h = ((pc >> 1) ^ (pc >> 11) ^ pid) % NPROFENT;
+  for(i = 0; i < NPROBE; i++){
+    e = &t->ent[(h + i) % NPROFENT];
+    if(e->count == 0){
+      e->pc = pc;
+      e->pid = pid;
+      e->cpu = cpuid();
+      if(p)
+        safestrcpy(e->name, p->name, sizeof(e->name));
+      e->count = 1;
+      return;
+    }
+    if(e->pc == pc && e->pid == pid){
+      e->count++;
+      return;
+    }
+  }
+  t->dropped++;
+}
+
+// Turn the profiler on, starting afresh, if on is not 0,
+// or off. Returns whether it was on.
+int
+profile(int on)
+{
+  int was = profon;
+
+  if(on && !was){
+    acquiresleep(&profrd.lock);
+    profgen++;
+    profrd.cpu = profrd.i = 0;
+    releasesleep(&profrd.lock);
+    __sync_synchronize();
+    profon = 1;
+  } else if(!on){
+    profon = 0;
+  }
+  return was;
+}
+
+// Read whole entries into dst, carrying on from the last read.
+static int
+profread(int user_dst, uint64 dst, int n)
+{
+  struct proftab *t;
+  struct profent e;
+  int got = 0;
+
+  acquiresleep(&profrd.lock);
+  for(; profrd.cpu < NCPU; profrd.cpu++, profrd.i = 0){
+    t = &proftabs[profrd.cpu];
+    if(t->gen != profgen)
+      continue;
+    // i == NPROFENT stands for the count of dropped samples.
+    for(; profrd.i <= NPROFENT; profrd.i++){
+      if(n - got < sizeof(e))
+        goto out;
+      if(profrd.i < NPROFENT){
+        e = t->ent[profrd.i];
+        if(e.count == 0)
+          continue;
+      } else {
+        if(t->dropped == 0)
+          continue;
+        memset(&e, 0, sizeof(e));
+        e.cpu = profrd.cpu;
+        e.count = t->dropped;
+      }
+      if(either_copyout(user_dst, dst + got, &e, sizeof(e)) < 0){
+        releasesleep(&profrd.lock);
+        return got > 0 ? got : -1;
+      }
+      got += sizeof(e);
+    }
+  }
+ out:
+  releasesleep(&profrd.lock);
+  return got;
+}
+
+void
+profinit(void)
+{
+  initsleeplock(&profrd.lock, "profile");
+  devsw[PROFILE].read = profread;
+}
@@ -0,0 +1,13 @@
+// Profile samples, read from the profile device (prof.c).
+
+// How often the timer interrupted pc, in process pid, on cpu.
+// pc is a kernel address (KERNBASE and above) or a user one.
+// An entry with pc 0 counts the samples that cpu dropped,
+// having no room for them.
+struct profent {
+  uint64 pc;
+  int pid;          // 0 if no process was running
+  uint count;
+  int cpu;
+  char name[16];    // pid's name when first sampled
+};
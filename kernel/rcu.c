@@ -0,0 +1,166 @@
+//
+// Read-copy update, for lock-free readers of lists that
+// change much less often than they are searched.
+//
+// A reader brackets its walk with rcureadlock() and
+// rcureadunlock(), which only disable interrupts, so that its
+// hart cannot switch away in between, and follows links with
+// rcuderef(). An updater, holding whatever lock orders updates,
+// publishes entries with rcuassign() and unlinks them with a
+// plain store; readers may still be looking at an unlinked
+// entry, so it must not be reused or freed until a grace period
+// has passed: until every hart has been through scheduler() or
+// come into the kernel from user space (usertrap()), where no
+// reader can be. rcusync() waits for one; rcudefer() has a
+// function called after one, from either place. A hart that runs
+// user code passes usertrap() at least every tick, even under
+// FCFS and PBS, which never send it back to scheduler().
+//
+// Each hart counts its passes through those places in c->rcuqs
+// (rcuquiesce()). A grace period begins by noting every hart's
+// count, and ends once each has changed, or was 0: a hart that
+// had not started, and so was not reading. One grace period
+// serves every rcudefer() made before it began.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+struct {
+  struct spinlock lock;
+  struct rcuhead *next;     // waiting for a grace period to begin
+  struct rcuhead **nexttail;
+  struct rcuhead *cur;      // waiting for the current one to end
+  uint64 snap[NCPU];        // the harts' counts when it began
+  int pending;              // is anything waiting?
+
+  // for rcusync(), whose wakeup() takes p->locks, which
+  // may be held by callers of rcudefer().
+  struct spinlock synclock;
+} rcu;
+
+void
+rcuinit(void)
+{
+  initlock(&rcu.lock, "rcu");
+  initlock(&rcu.synclock, "rcusync");
+  rcu.nexttail = &rcu.next;
+}
+
+// Disallow switching away from a reader.
+void
+rcureadlock(void)
+{
+  push_off();
+}
+
+void
+rcureadunlock(void)
+{
+  pop_off();
+}
+
+// Has every hart passed through scheduler() since the
+// current grace period began? Caller holds rcu.lock.
+static int
+rcupassed(void)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    if(rcu.snap[i] != 0 && __atomic_load_n(&cpus[i].rcuqs, __ATOMIC_RELAXED) == rcu.snap[i])
+      return 0;
+  return 1;
+}
+
+// Called on hart c by scheduler(), between processes, and by
+// usertrap(), on entry from user space, where no reader can be.
+// Ends the grace period if this was the last hart it waited
+// for, calling what was deferred until then, and begins the
+// next if anything is waiting for one.
+void
+rcuquiesce(struct cpu *c)
+{
+  struct rcuhead *h, *done;
+  int i;
+
+  // this hart's readers are done with what they read.
+  __sync_synchronize();
+  __atomic_store_n(&c->rcuqs, c->rcuqs + 1, __ATOMIC_RELAXED);
+  if(__atomic_load_n(&rcu.pending, __ATOMIC_RELAXED) == 0)
+    return;
+
+  acquire(&rcu.lock);
+  done = 0;
+  if(rcu.cur && rcupassed()){
+    done = rcu.cur;
+    rcu.cur = 0;
+  }
+  if(rcu.cur == 0 && rcu.next){
+    rcu.cur = rcu.next;
+    rcu.next = 0;
+    rcu.nexttail = &rcu.next;
+    for(i = 0; i < NCPU; i++)
+      rcu.snap[i] = __atomic_load_n(&cpus[i].rcuqs, __ATOMIC_RELAXED);
+  }
+  rcu.pending = rcu.cur != 0;
+  release(&rcu.lock);
+
+  // in the order they were deferred; fn may reuse h.
+  for(; done; done = h){
+    h = done->next;
+    done->fn(done->arg);
+  }
+}
+
+// Call fn(arg) once a grace period has passed, using h,
+// which must stay untouched until then.
+void
+rcudefer(struct rcuhead *h, void (*fn)(void*), void *arg)
+{
+  h->next = 0;
+  h->fn = fn;
+  h->arg = arg;
+  acquire(&rcu.lock);
+  *rcu.nexttail = h;
+  rcu.nexttail = &h->next;
+  rcu.pending = 1;
+  release(&rcu.lock);
+}
+
+// Is anything deferred, and not yet called?
+int
+rcupending(void)
+{
+  return __atomic_load_n(&rcu.pending, __ATOMIC_RELAXED);
+}
+
+static void
+rcuwake(void *done)
+{
+  acquire(&rcu.synclock);
+  *(int*)done = 1;
+  wakeup(done);
+  release(&rcu.synclock);
+}
+
+// Wait for a grace period to pass, and everything
+// deferred before the call to have been called.
+// Must not be called by a reader.
+void
+rcusync(void)
+{
+  struct rcuhead h;
+  int done = 0;
+
+  rcudefer(&h, rcuwake, &done);
+  acquire(&rcu.synclock);
+  while(!done)
+    sleep(&done, &rcu.synclock);
+  release(&rcu.synclock);
+}
@@ -0,0 +1,244 @@
+//
+// Syscall rings: batched, asynchronous file operations.
+//
+// ring_setup() maps a page holding a submission ring and a
+// completion ring (struct ringpage, ring.h) into the calling
+// process, and starts kernel workers for it: threads of the
+// process (kthread()) that never return to user space. User
+// code queues operations on the submission ring and calls
+// ring_enter() to wake the workers and, if it likes, to wait
+// for completions. The workers carry out each operation as the
+// system call would (ringop() in sysfile.c), in the process's
+// memory and with its open files, and post the result on the
+// completion ring. Workers take entries as long as there are
+// any, so a process that keeps the ring full traps only to
+// wait. There are at most NRINGENT operations in flight or
+// unreaped at once, so the completion ring never overflows.
+//
+// The ring page is user memory, so the kernel keeps its own
+// copies of the indices it advances, and only trusts sqtail
+// and cqhead as far as they are consistent with those.
+//
+// The workers are killed when the last of the process's other
+// threads exits, and it waits for them to have exited before it
+// closes the files; the page is freed with the mm. fork() children
+// do not get the ring, and exec() fails while workers run, as
+// for any process with more than one thread.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "ring.h"
+
+extern struct proc *procs;
+
+struct ring {
+  struct spinlock lock;
+  struct ringpage *page;  // shared with user space
+  uint64 uaddr;           // where the process maps page
+  uint sqhead;            // the kernel's copy of page->sqhead
+  uint cqtail;            // and of page->cqtail
+  int inflight;           // entries taken but not yet completed
+  int stop;               // workers should exit
+};
+
+// Is there an entry for a worker to take, and
+// room for its completion? Caller holds r->lock.
+static int
+ringready(struct ring *r)
+{
+  uint sqtail = r->page->sqtail;
+  uint ncq = r->cqtail - r->page->cqhead;
+
+  if(sqtail == r->sqhead || sqtail - r->sqhead > NRINGENT)
+    return 0;
+  return ncq <= NRINGENT && ncq + r->inflight < NRINGENT;
+}
+
+// A ring worker's kernel thread.
+static void
+ringworker(void)
+{
+  struct proc *p = myproc();
+  struct ring *r = p->mm->ring;
+  struct ringsqe e;
+  struct ringcqe *c;
+  int res;
+
+  acquire(&r->lock);
+  for(;;){
+    while(!r->stop && !ringready(r))
+      sleep(r, &r->lock);
+    if(r->stop)
+      break;
+    // read the entry only after the sqtail that covers it.
+    __sync_synchronize();
+    e = r->page->sq[r->sqhead % NRINGENT];
+    r->page->sqhead = ++r->sqhead;
+    r->inflight++;
+    release(&r->lock);
+
+    res = ringop(&e);
+
+    acquire(&r->lock);
+    c = &r->page->cq[r->cqtail % NRINGENT];
+    c->data = e.data;
+    c->res = res;
+    __sync_synchronize();
+    r->page->cqtail = ++r->cqtail;
+    r->inflight--;
+    wakeup(&r->cqtail);
+  }
+  release(&r->lock);
+  exit(0);
+}
+
+// Map a ring page into the current process, and start nworker
+// workers for it. Returns the page's address, or -1.
+uint64
+ringsetup(int nworker)
+{
+  struct proc *p = myproc();
+  struct ring *r;
+  struct vma *v;
+  int i, n;
+
+  if(nworker < 1 || nworker > NRINGWORKER)
+    return -1;
+  if((r = (struct ring*)kalloc()) == 0)
+    return -1;
+  memset(r, 0, sizeof(*r));
+  initlock(&r->lock, "ring");
+  if((r->page = (struct ringpage*)kalloc()) == 0){
+    kfree((void*)r);
+    return -1;
+  }
+  memset(r->page, 0, PGSIZE);
+
+  mmbegin(p);
+  acquire(&p->mm->lock);
+  if(p->mm->ring || (v = vmaalloc(p, PGSIZE)) == 0){
+    release(&p->mm->lock);
+    goto bad;
+  }
+  if(mappages(p->pagetable, v->addr, PGSIZE, (uint64)r->page, PTE_R|PTE_W|PTE_U) != 0){
+    v->addr = 0;
+    release(&p->mm->lock);
+    goto bad;
+  }
+  // a vma with neither a segment nor a file, which
+  // munmap() and shmdt() refuse, and fork() skips.
+  r->uaddr = v->addr;
+  p->mm->ring = r;
+  release(&p->mm->lock);
+  kvmsync(p->kpagetable, p->pagetable);
+  uvmflush(p, r->uaddr, 1);
+  mmend(p);
+
+  for(i = n = 0; i < nworker; i++)
+    if(kthread(ringworker) >= 0)
+      n++;
+  if(n > 0)
+    return r->uaddr;
+
+  // nothing would ever take the entries.
+  mmbegin(p);
+  acquire(&p->mm->lock);
+  p->mm->ring = 0;
+  if((v = vmalookup(p, r->uaddr)) != 0)
+    v->addr = 0;
+  release(&p->mm->lock);
+  uvmunmap(p->pagetable, r->uaddr, 1, 0);
+  uvmflush(p, r->uaddr, 1);
+  mmquiesce(p);
+  mmend(p);
+  kfree((void*)r->page);
+  kfree((void*)r);
+  return -1;
+
+ bad:
+  mmend(p);
+  kfree((void*)r->page);
+  kfree((void*)r);
+  return -1;
+}
+
+// Wake the current process's ring workers, if submit is not 0,
+// to take newly submitted entries, or if there is work for them
+// now that reaping has made room for completions. Then wait
+// until there are at least nwait completions to reap.
+// Returns how many there are, or -1.
+int
+ringenter(int submit, int nwait)
+{
+  struct proc *p = myproc();
+  struct ring *r = p->mm->ring;
+  uint n;
+
+  if(r == 0 || nwait < 0 || nwait > NRINGENT)
+    return -1;
+  acquire(&r->lock);
+  if(submit || ringready(r))
+    wakeup(r);
+  while((n = r->cqtail - r->page->cqhead) < (uint)nwait){
+    if(killed(p)){
+      release(&r->lock);
+      return -1;
+    }
+    sleep(&r->cqtail, &r->lock);
+  }
+  release(&r->lock);
+  return n > NRINGENT ? -1 : n;
+}
+
+// Tell m's ring workers to exit, as the last of the process's
+// other threads exits, and wait until they have. A worker may be
+// in the middle of an operation that sleeps, reading a pipe or
+// the console, so they are killed, as by kill(), too.
+void
+ringstop(struct mm *m)
+{
+  struct ring *r = m->ring;
+  struct proc *q;
+
+  if(r == 0)
+    return;
+  acquire(&r->lock);
+  r->stop = 1;
+  wakeup(r);
+  release(&r->lock);
+
+  for(q = procs; q; q = q->allnext){
+    acquire(&q->lock);
+    if(q->mm == m && q->kfn && q->state != ZOMBIE){
+      q->killed = 1;
+      if(q->state == SLEEPING)
+        q->state = RUNNABLE;
+    }
+    release(&q->lock);
+  }
+
+  acquire(&m->lock);
+  while(m->nkthread > 0)
+    sleep(&m->nkthread, &m->lock);
+  release(&m->lock);
+}
+
+// Unmap and free p's ring, as its mm is freed.
+void
+ringfree(struct proc *p)
+{
+  struct ring *r = p->mm->ring;
+
+  if(r == 0)
+    return;
+  uvmunmap(p->pagetable, r->uaddr, 1, 0);
+  p->mm->ring = 0;
+  kfree((void*)r->page);
+  kfree((void*)r);
+}
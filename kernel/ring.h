@@ -0,0 +1,44 @@
+// Syscall rings, set up by ring_setup() (ring.c).
+
+#define NRINGENT     64  // entries in each ring
+#define NRINGWORKER   4  // most kernel workers per ring
+
+// ringsqe.op
+#define RING_READ     1
+#define RING_WRITE    2
+#define RING_FSYNC    3
+#define RING_OPEN     4
+#define RING_CLOSE    5
+
+// An operation, with the arguments of the system call of
+// the same name: fd, then addr and len for the buffer of
+// RING_READ and RING_WRITE, or the path and omode of RING_OPEN.
+struct ringsqe {
+  int op;
+  int fd;
+  uint64 addr;
+  int len;
+  int pad;
+  uint64 data;      // handed back in the completion
+};
+
+// A completed operation.
+struct ringcqe {
+  uint64 data;      // the ringsqe's data
+  int res;          // what the system call would return
+  int pad;
+};
+
+// The page that ring_setup() maps. The submitter fills in
+// sq[sqtail % NRINGENT] and then advances sqtail; the kernel
+// advances sqhead as its workers take entries. The kernel
+// fills in cq[cqtail % NRINGENT] and then advances cqtail;
+// the reaper advances cqhead once done with an entry.
+struct ringpage {
+  uint sqhead;
+  uint sqtail;
+  uint cqhead;
+  uint cqtail;
+  struct ringsqe sq[NRINGENT];
+  struct ringcqe cq[NRINGENT];
+};
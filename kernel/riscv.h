@@ -42,6 +42,12 @@ w_mepc(uint64 x)
 
 // Supervisor Status Register, sstatus
 
+#define SSTATUS_SUM (1L << 18) // Supervisor may access User memory
+#define SSTATUS_FS (3L << 13)  // Floating-point unit state:
+#define SSTATUS_FS_OFF (0L << 13)     //   FP instructions trap
+#define SSTATUS_FS_INITIAL (1L << 13) //   registers hold no state yet
+#define SSTATUS_FS_CLEAN (2L << 13)   //   unchanged since last saved
+#define SSTATUS_FS_DIRTY (3L << 13)   //   changed since last saved
 #define SSTATUS_SPP (1L << 8)  // Previous mode, 1=Supervisor, 0=User
 #define SSTATUS_SPIE (1L << 5) // Supervisor Previous Interrupt Enable
 #define SSTATUS_UPIE (1L << 4) // User Previous Interrupt Enable
@@ -199,7 +205,14 @@ w_pmpaddr0(uint64 x)
 // use riscv's sv39 page table scheme.
 #define SATP_SV39 (8L << 60)
 
+// satp bits 44..59 hold the address-space identifier (ASID)
+// that tags the TLB entries loaded through this page table.
+#define SATP_ASID_SHIFT 44
+#define SATP_ASID_MASK (0xFFFFL << SATP_ASID_SHIFT)
+
 #define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
+#define MAKE_SATP_ASID(pagetable, asid) \
+  (MAKE_SATP(pagetable) | (((uint64)(asid)) << SATP_ASID_SHIFT))
 
 // supervisor address translation and protection;
 // holds the address of the page table.
@@ -256,6 +269,16 @@ r_mcounteren()
   return x;
 }
 
+// Supervisor Counter-Enable
+static inline void 
+w_scounteren(uint64 x)
+{
+  asm volatile("csrw scounteren, %0" : : "r" (x));
+}
+
+// counter-enable bit for the time CSR.
+#define COUNTEREN_TM (1L << 1)
+
 // machine-mode cycle counter
 static inline uint64
 r_time()
@@ -327,6 +350,21 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// flush the TLB entries of one address space.
+static inline void
+sfence_vma_asid(uint64 asid)
+{
+  asm volatile("sfence.vma zero, %0" : : "r" (asid));
+}
+
+// flush the TLB entry for virtual address va
+// in address space asid.
+static inline void
+sfence_vma_page(uint64 va, uint64 asid)
+{
+  asm volatile("sfence.vma %0, %1" : : "r" (va), "r" (asid));
+}
+
 typedef uint64 pte_t;
 typedef uint64 *pagetable_t; // 512 PTEs
 
@@ -343,6 +381,9 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // user can access
+#define PTE_A (1L << 6) // accessed
+#define PTE_D (1L << 7) // dirty
+#define PTE_S (1L << 8) // swapped out (swap.c); PTE_V is clear
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
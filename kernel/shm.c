@@ -0,0 +1,310 @@
+//
+// Anonymous shared-memory segments.
+//
+// shmget() finds or creates a segment of zeroed pages.
+// shmat() maps all of a segment's pages into the calling
+// process, between MMAPBASE and USERTOP, and shmdt() unmaps
+// them again. Processes attached to the same segment see the
+// same physical pages, so they can exchange data without the
+// kernel copying it.
+// fork() gives the child the parent's attachments; exec()
+// and exit() detach them all. A segment and its pages are
+// freed when the last process attached to it detaches, or,
+// if none ever attached it, when the process that created
+// it execs or exits. Threads share their attachments.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+// the physical addresses of a segment's pages fill one page.
+#define SHMMAXPAGES (PGSIZE / sizeof(uint64))
+
+struct shmseg {
+  int used;
+  int key;            // shmget() key; 0 for a private segment
+  int nattach;        // processes that have the segment mapped,
+                      // and 1 while creator is set
+  struct mm *creator; // creator, until it first attaches
+  int npages;
+  uint64 *pages;      // physical addresses of the pages
+};
+
+struct {
+  struct spinlock lock;
+  struct shmseg segs[NSHM];
+} shm;
+
+void
+shminit(void)
+{
+  initlock(&shm.lock, "shm");
+}
+
+// Free a segment's pages.
+static void
+shmfree(uint64 *pages, int npages)
+{
+  int i;
+
+  for(i = 0; i < npages; i++)
+    kfree((void*)pages[i]);
+  kfree((void*)pages);
+}
+
+// Return the id of the segment with the given key, creating
+// it, of size bytes, if there is none. Key 0 always creates
+// a new, private segment. Returns -1 if an existing segment
+// is smaller than size, or if out of segments or memory.
+int
+shmget(int key, int size)
+{
+  struct shmseg *s;
+  uint64 *pages;
+  int i, npages;
+
+  if(size < 0)
+    return -1;
+  npages = PGROUNDUP((uint64)size) / PGSIZE;
+
+  if(key != 0){
+    acquire(&shm.lock);
+    for(s = shm.segs; s < &shm.segs[NSHM]; s++){
+      if(s->used && s->key == key){
+        i = s->npages >= npages ? s - shm.segs : -1;
+        release(&shm.lock);
+        return i;
+      }
+    }
+    release(&shm.lock);
+  }
+
+  if(npages == 0 || npages > SHMMAXPAGES)
+    return -1;
+  if((pages = kalloc()) == 0)
+    return -1;
+  for(i = 0; i < npages; i++){
+    if((pages[i] = (uint64)kalloc()) == 0){
+      shmfree(pages, i);
+      return -1;
+    }
+    memset((void*)pages[i], 0, PGSIZE);
+  }
+
+  acquire(&shm.lock);
+  if(key != 0){
+    // did another process create it meanwhile?
+    for(s = shm.segs; s < &shm.segs[NSHM]; s++){
+      if(s->used && s->key == key){
+        i = s->npages >= npages ? s - shm.segs : -1;
+        release(&shm.lock);
+        shmfree(pages, npages);
+        return i;
+      }
+    }
+  }
+  for(s = shm.segs; s < &shm.segs[NSHM]; s++){
+    if(s->used == 0){
+      s->used = 1;
+      s->key = key;
+      s->nattach = 1;
+      s->creator = myproc()->mm;
+      s->npages = npages;
+      s->pages = pages;
+      release(&shm.lock);
+      return s - shm.segs;
+    }
+  }
+  release(&shm.lock);
+  shmfree(pages, npages);
+  return -1;
+}
+
+// Drop an attachment to s, freeing s with the last one.
+static void
+shmput(struct shmseg *s)
+{
+  uint64 *pages = 0;
+  int npages = 0;
+
+  acquire(&shm.lock);
+  if(--s->nattach == 0){
+    pages = s->pages;
+    npages = s->npages;
+    s->used = 0;
+    s->pages = 0;
+  }
+  release(&shm.lock);
+  if(pages)
+    shmfree(pages, npages);
+}
+
+// Undo shmat()'s attachment to s by p, which failed: hand
+// back p's creation reference if it took that, else drop it.
+static void
+shmunat(struct proc *p, struct shmseg *s, int creator)
+{
+  if(creator){
+    acquire(&shm.lock);
+    s->creator = p->mm;
+    release(&shm.lock);
+  } else {
+    shmput(s);
+  }
+}
+
+// Map the pages of s at v->addr in p.
+// Returns 0, or -1 (with nothing mapped) if out of memory.
+static int
+shmmap(struct proc *p, struct vma *v, struct shmseg *s)
+{
+  int i;
+
+  for(i = 0; i < s->npages; i++){
+    if(mappages(p->pagetable, v->addr + (uint64)i*PGSIZE, PGSIZE,
+                s->pages[i], PTE_R|PTE_W|PTE_U) != 0){
+      if(i > 0)
+        uvmunmap(p->pagetable, v->addr, i, 0);
+      return -1;
+    }
+  }
+  v->shm = s;
+  return 0;
+}
+
+// Attach segment id to the current process.
+// Returns the address it is mapped at, or -1.
+uint64
+shmat(int id)
+{
+  struct proc *p = myproc();
+  struct shmseg *s;
+  struct vma *v;
+  int creator;
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  s = &shm.segs[id];
+  acquire(&shm.lock);
+  if(s->used == 0){
+    release(&shm.lock);
+    return -1;
+  }
+  // the creator's first attachment takes over its reference.
+  creator = s->creator == p->mm;
+  if(creator)
+    s->creator = 0;
+  else
+    s->nattach++;
+  release(&shm.lock);
+
+  mmbegin(p);
+  acquire(&p->mm->lock);
+  if((v = vmaalloc(p, (uint64)s->npages*PGSIZE)) == 0){
+    release(&p->mm->lock);
+    mmend(p);
+    shmunat(p, s, creator);
+    return -1;
+  }
+  if(shmmap(p, v, s) < 0){
+    v->addr = 0;
+    release(&p->mm->lock);
+    mmend(p);
+    shmunat(p, s, creator);
+    return -1;
+  }
+  release(&p->mm->lock);
+  kvmsync(p->kpagetable, p->pagetable);
+  uvmflush(p, v->addr, s->npages);
+  mmend(p);
+  return v->addr;
+}
+
+// Unmap v's segment from p and drop the attachment.
+// Called by p itself, or with p->lock held while p is
+// not running.
+static void
+shmdetach(struct proc *p, struct vma *v)
+{
+  uvmunmap(p->pagetable, v->addr, v->len / PGSIZE, 0);
+  uvmflush(p, v->addr, v->len / PGSIZE);
+  // p's other threads may still hold the pages in their TLBs.
+  mmquiesce(p);
+  shmput(v->shm);
+  v->addr = 0;
+  v->len = 0;
+  v->shm = 0;
+}
+
+// Detach the segment attached at addr.
+int
+shmdt(uint64 addr)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+
+  mmbegin(p);
+  v = vmalookup(p, addr);
+  if(v == 0 || v->shm == 0 || v->addr != addr){
+    mmend(p);
+    return -1;
+  }
+  shmdetach(p, v);
+  mmend(p);
+  return 0;
+}
+
+// Give child np the segments that p has attached,
+// at the same addresses. Returns 0, or -1 if out of
+// memory, in which case some may have been attached.
+int
+shmfork(struct proc *p, struct proc *np)
+{
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    if(p->mm->vmas[i].addr == 0 || p->mm->vmas[i].shm == 0)
+      continue;
+    acquire(&shm.lock);
+    p->mm->vmas[i].shm->nattach++;
+    release(&shm.lock);
+    np->mm->vmas[i] = p->mm->vmas[i];
+    if(shmmap(np, &np->mm->vmas[i], p->mm->vmas[i].shm) < 0){
+      np->mm->vmas[i].addr = 0;
+      shmput(p->mm->vmas[i].shm);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Detach all of p's segments, for exec() and exit(), and
+// drop those it created but never attached.
+// Called by p itself, or with p->lock held while p is
+// not running.
+void
+shmdetachall(struct proc *p)
+{
+  struct shmseg *s;
+  struct vma *v;
+  int created;
+
+  for(v = p->mm->vmas; v < &p->mm->vmas[NVMA]; v++)
+    if(v->addr && v->shm)
+      shmdetach(p, v);
+
+  for(s = shm.segs; s < &shm.segs[NSHM]; s++){
+    acquire(&shm.lock);
+    created = s->used && s->creator == p->mm;
+    if(created)
+      s->creator = 0;
+    release(&shm.lock);
+    if(created)
+      shmput(s);
+  }
+}
@@ -1,4 +1,10 @@
 // Sleeping locks
+//
+// A process that finds a sleeplock held spins for a while,
+// rather than sleep, if the holder is running on another hart,
+// since then it is likely to release it soon: most holds, of
+// inodes and buffers, are short. Only if the holder is not
+// running, or SLEEPSPIN tries go by, does it sleep.
 
 #include "types.h"
 #include "riscv.h"
@@ -16,17 +22,71 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
+#ifdef LOCKSTAT
+  lk->stat = lockclass(name, 1);
+#endif
+}
+
+// Spin while lk is held by a process running on another hart,
+// for at most SLEEPSPIN tries. Returns 0 at once, without
+// spinning, if the holder is not running; otherwise 1, after
+// which lk may have been released. Called, and returns, with
+// lk->lk held.
+static int
+sleepspin(struct sleeplock *lk)
+{
+  struct proc *owner = lk->owner;
+  int i;
+
+  // the holder's proc stays valid: procs are never freed.
+  if(owner == 0 || owner == myproc() || owner->state != RUNNING)
+    return 0;
+  release(&lk->lk);
+  for(i = 0; i < SLEEPSPIN; i++){
+    if(__atomic_load_n(&lk->locked, __ATOMIC_RELAXED) == 0 ||
+       __atomic_load_n(&lk->owner, __ATOMIC_RELAXED) != owner ||
+       __atomic_load_n(&owner->state, __ATOMIC_RELAXED) != RUNNING)
+      break;
+  }
+  acquire(&lk->lk);
+  return 1;
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  int spun = 0;
+#ifdef LOCKSTAT
+  uint64 sleeps = 0;
+  int spinwait = 0;
+#endif
+
   acquire(&lk->lk);
   while (lk->locked) {
+    // spin once for each sleep, and look again after,
+    // since lk may have been released meanwhile.
+    if (!spun && sleepspin(lk)) {
+      spun = 1;
+#ifdef LOCKSTAT
+      spinwait = 1;
+#endif
+      continue;
+    }
     sleep(lk, &lk->lk);
+    spun = 0;
+#ifdef LOCKSTAT
+    sleeps++;
+#endif
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->owner = myproc();
+#ifdef LOCKSTAT
+  if(spinwait)
+    lockstatspun(lk->stat, sleeps == 0);
+  lk->holdstart = lockstatacquired(lk->stat, sleeps);
+#endif
   release(&lk->lk);
 }
 
@@ -34,12 +94,28 @@ void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
+#ifdef LOCKSTAT
+  lockstatreleased(lk->stat, lk->holdstart);
+#endif
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
   wakeup(lk);
   release(&lk->lk);
 }
 
+// Hand lk, which the caller holds, to a device, which will
+// releasesleep() it when done: the caller no longer holds it,
+// and there is no process for waiters to spin on.
+void
+sleephandoff(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  lk->pid = 0;
+  lk->owner = 0;
+  release(&lk->lk);
+}
+
 int
 holdingsleep(struct sleeplock *lk)
 {
@@ -6,5 +6,11 @@ struct sleeplock {
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+  struct proc *owner; // And its proc, to spin while it runs
+
+#ifdef LOCKSTAT
+  struct lockstat *stat;  // Counts for locks of this name (lockstat.c)
+  uint64 holdstart;       // When acquired, for the hold time
+#endif
 };
 
@@ -7,30 +7,58 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "vdso.h"
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
+#ifdef TICKETLOCK
+  lk->next = lk->owner = 0;
+#else
   lk->locked = 0;
+#endif
   lk->cpu = 0;
+#ifdef LOCKSTAT
+  lk->stat = lockclass(name, 0);
+#endif
 }
 
 // Acquire the lock.
 // Loops (spins) until the lock is acquired.
+// With TICKETLOCK, waiters get the lock in the order they
+// asked for it, and spin only reading lk->owner, which changes
+// once per release, rather than each swapping lk->locked.
 void
 acquire(struct spinlock *lk)
 {
+#ifdef LOCKSTAT
+  uint64 spins = 0;
+#endif
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
+#ifdef TICKETLOCK
+  // On RISC-V, the fetch-and-add turns into an amoadd.w.
+  uint ticket = __atomic_fetch_add(&lk->next, 1, __ATOMIC_RELAXED);
+  while(__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != ticket){
+#ifdef LOCKSTAT
+    spins++;
+#endif
+  }
+#else
   // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  while(__sync_lock_test_and_set(&lk->locked, 1) != 0){
+#ifdef LOCKSTAT
+    spins++;
+#endif
+  }
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +68,9 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+#ifdef LOCKSTAT
+  lk->holdstart = lockstatacquired(lk->stat, spins);
+#endif
 }
 
 // Release the lock.
@@ -49,6 +80,9 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+#ifdef LOCKSTAT
+  lockstatreleased(lk->stat, lk->holdstart);
+#endif
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,6 +93,10 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
+#ifdef TICKETLOCK
+  // Serve the next ticket. Only the holder writes owner.
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELEASE);
+#else
   // Release the lock, equivalent to lk->locked = 0.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
@@ -67,6 +105,7 @@ release(struct spinlock *lk)
   //   s1 = &lk->locked
   //   amoswap.w zero, zero, (s1)
   __sync_lock_release(&lk->locked);
+#endif
 
   pop_off();
 }
@@ -77,7 +116,11 @@ int
 holding(struct spinlock *lk)
 {
   int r;
+#ifdef TICKETLOCK
+  r = (lk->owner != lk->next && lk->cpu == mycpu());
+#else
   r = (lk->locked && lk->cpu == mycpu());
+#endif
   return r;
 }
 
@@ -108,3 +151,29 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// A lock for lockbench() callers on all harts to fight
+// over, and the data it guards.
+static struct spinlock benchlock = { .name = "lockbench" };
+static uint64 benchdata[8];
+
+// Take and release benchlock, touching the data it guards
+// each time, for ms milliseconds. Returns how many times.
+int
+lockbench(int ms)
+{
+  uint64 end;
+  int i, n = 0;
+
+  if(ms < 1 || ms > 10000)
+    return -1;
+  end = r_time() + (uint64)ms * TIMEBASE / 1000;
+  while(r_time() < end){
+    acquire(&benchlock);
+    for(i = 0; i < NELEM(benchdata); i++)
+      benchdata[i]++;
+    release(&benchlock);
+    n++;
+  }
+  return n;
+}
@@ -1,9 +1,26 @@
 // Mutual exclusion lock.
 struct spinlock {
+#ifdef TICKETLOCK
+  uint next;         // Next ticket to hand out
+  uint owner;        // Ticket of the holder; held if not next
+#else
   uint locked;       // Is the lock held?
+#endif
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+#ifdef LOCKSTAT
+  struct lockstat *stat;  // Counts for locks of this name (lockstat.c)
+  uint64 holdstart;       // When acquired, for the hold time
+#endif
+};
+
+// Something to do after an RCU grace period (rcu.c).
+struct rcuhead {
+  struct rcuhead *next;
+  void (*fn)(void*);
+  void *arg;
 };
 
@@ -43,6 +43,11 @@ start()
   w_pmpaddr0(0x3fffffffffffffull);
   w_pmpcfg0(0xf);
 
+  // let supervisor and user mode read the time CSR,
+  // for the vDSO (vdso.c) and rdtime in user code.
+  w_mcounteren(r_mcounteren() | COUNTEREN_TM);
+  w_scounteren(COUNTEREN_TM);
+
   // ask for clock interrupts.
   timerinit();
 
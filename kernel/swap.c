@@ -0,0 +1,254 @@
+//
+// Swapping of user pages to the swap area that mkfs
+// leaves after the file system on the disk.
+//
+// When free memory runs low, swapkalloc() makes room by
+// evicting user pages. Victims are chosen by a clock
+// (second-chance) sweep over the resident user pages of the
+// processes that are not running: a page whose PTE_A bit is
+// set has been used since the hand last passed it, so the
+// sweep clears the bit and moves on; the first page found
+// with PTE_A clear is written to a free swap slot, and its
+// PTE is replaced by one with PTE_V clear, PTE_S set, and
+// the slot number where the physical page number was.
+// A later access to the page faults, and uvmfault() reads
+// it back in with swapin().
+//
+// The swap sleep-lock is held across every swap read and
+// write, so a page cannot be read back in before the write
+// that put it out has finished.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "defs.h"
+
+#define BPS       (PGSIZE / BSIZE)       // disk blocks per swap slot
+#define NSLOT     (SWAPBLOCKS / BPS)     // most slots we can manage
+#define RESERVE   64                     // free pages kept for the kernel
+
+// a swapped-out PTE holds its slot in the PPN field.
+#define SLOT2PTE(slot) (((uint64)(slot)) << 10)
+#define PTE2SLOT(pte)  ((uint)((pte) >> 10))
+
+extern struct proc *procs;
+extern int nproc;
+extern struct superblock sb;
+
+struct {
+  struct spinlock lock;    // protects map[] and the counters
+  struct sleeplock io;     // held across swap I/O
+  uint nslot;              // slots in the swap area; 0 if none
+  uchar map[NSLOT / 8];    // a set bit means the slot is in use
+  uint nused;
+
+  // the clock hand, at page va of process hand.
+  // only moved with io held.
+  struct proc *hand;
+  uint64 handva;
+} swap;
+
+// Called by fsinit(), once the superblock has been read.
+void
+swapinit(void)
+{
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swap.io, "swapio");
+  swap.nslot = sb.nswap / BPS;
+  if(swap.nslot > NSLOT)
+    swap.nslot = NSLOT;
+  if(swap.nslot > 0)
+    printf("swap: %d pages at block %d\n", swap.nslot, sb.swapstart);
+}
+
+static uint
+slotblock(uint slot)
+{
+  return sb.swapstart + slot * BPS;
+}
+
+// Allocate a swap slot. Returns -1 if the swap area is full.
+static int
+slotalloc(void)
+{
+  int slot;
+
+  acquire(&swap.lock);
+  for(slot = 0; slot < swap.nslot; slot++){
+    if((swap.map[slot/8] & (1 << (slot%8))) == 0){
+      swap.map[slot/8] |= 1 << (slot%8);
+      swap.nused++;
+      release(&swap.lock);
+      return slot;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+static void
+slotfree(uint slot)
+{
+  acquire(&swap.lock);
+  if(slot >= swap.nslot || (swap.map[slot/8] & (1 << (slot%8))) == 0)
+    panic("slotfree");
+  swap.map[slot/8] &= ~(1 << (slot%8));
+  swap.nused--;
+  release(&swap.lock);
+}
+
+// Release the swap slot of a swapped-out PTE,
+// when the page is unmapped. Does not sleep.
+void
+swapfree(pte_t pte)
+{
+  if((pte & PTE_S) == 0)
+    panic("swapfree");
+  slotfree(PTE2SLOT(pte));
+}
+
+// Can the clock take pages from q?
+// Not while q runs on some hart, except
+// when q is the caller, which is in the kernel.
+// Never if q has threads, which may be running
+// on the same page table elsewhere, nor while q
+// uses one of its pages by physical address
+// (uvmpin()), even if q was preempted or sleeps.
+// Caller holds q->lock.
+static int
+evictable(struct proc *q)
+{
+  if(q->pagetable == 0 || q->mm->ref > 1 || q->pinned)
+    return 0;
+  if(q == myproc())
+    return 1;
+  return q->state == RUNNABLE || q->state == SLEEPING;
+}
+
+// Write one user page out to the swap area and free it.
+// Returns 0 on success, -1 if the swap area is full or
+// there is no page to take.
+static int
+swapout(void)
+{
+  struct proc *q;
+  pte_t *pte;
+  uint64 va, pa;
+  int slot, n;
+
+  acquiresleep(&swap.io);
+  if((slot = slotalloc()) < 0){
+    releasesleep(&swap.io);
+    return -1;
+  }
+
+  // the first trip around may only clear PTE_A bits,
+  // so allow two.
+  for(n = 0; n <= 2*nproc; n++){
+    if(swap.hand == 0)
+      swap.hand = procs;
+    q = swap.hand;
+    acquire(&q->lock);
+    if(evictable(q)){
+      for(va = swap.handva; va < q->mm->sz; va += PGSIZE){
+        pte = walk(q->pagetable, va, 0);
+        if(pte == 0 || (*pte & (PTE_V|PTE_U)) != (PTE_V|PTE_U))
+          continue;
+        if(*pte & PTE_A){
+          // referenced since the hand last came by;
+          // give it a second chance.
+          *pte &= ~PTE_A;
+          uvmflush(q, va, 1);
+          continue;
+        }
+        pa = PTE2PA(*pte);
+        *pte = SLOT2PTE(slot) | (PTE_FLAGS(*pte) & ~PTE_V) | PTE_S;
+        uvmflush(q, va, 1);
+        q->nswapout++;
+        swap.handva = va + PGSIZE;
+        release(&q->lock);
+
+        virtio_disk_rwpage(slotblock(slot), (void*)pa, 1);
+        kfree((void*)pa);
+        releasesleep(&swap.io);
+        return 0;
+      }
+    }
+    release(&q->lock);
+    swap.hand = q->allnext;
+    swap.handva = 0;
+  }
+
+  slotfree(slot);
+  releasesleep(&swap.io);
+  return -1;
+}
+
+// Allocate a page for user memory, freeing unused page-cache
+// pages, which cost no write, and then swapping user pages
+// out while memory is short. Swapping starts before kalloc()
+// runs dry, leaving a reserve of free pages for the kernel's
+// own allocations (page tables, trapframes, pipes), which
+// cannot wait for swapping.
+// Returns 0 if no page could be had.
+// May sleep; the caller must hold no spinlocks.
+void *
+swapkalloc(void)
+{
+  while(kfreepages() < RESERVE && (pcreclaim() == 0 || swapout() == 0))
+    ;
+  return kalloc();
+}
+
+// Read the swapped-out page of pte into mem,
+// leaving the slot in use. Used by fork.
+void
+swapread(pte_t pte, void *mem)
+{
+  if((pte & PTE_S) == 0)
+    panic("swapread");
+  acquiresleep(&swap.io);
+  virtio_disk_rwpage(slotblock(PTE2SLOT(pte)), mem, 0);
+  releasesleep(&swap.io);
+}
+
+// Read the page at va in pagetable back in from swap.
+// Returns 0 if the page is resident afterwards,
+// -1 if it is not mapped or memory is exhausted.
+// The caller must flush the TLB entry for va.
+int
+swapin(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  void *mem;
+  uint slot;
+
+  // allocate before taking the lock; making
+  // room may need to swap something out.
+  if((mem = swapkalloc()) == 0)
+    return -1;
+
+  acquiresleep(&swap.io);
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & PTE_S) == 0){
+    // not swapped out, or no longer.
+    releasesleep(&swap.io);
+    kfree(mem);
+    return (pte && (*pte & PTE_V)) ? 0 : -1;
+  }
+  slot = PTE2SLOT(*pte);
+  virtio_disk_rwpage(slotblock(slot), mem, 0);
+  *pte = PA2PTE(mem) | (PTE_FLAGS(*pte) & ~PTE_S) | PTE_V;
+  slotfree(slot);
+  if(p && p->pagetable == pagetable)
+    p->nswapin++;
+  releasesleep(&swap.io);
+  return 0;
+}
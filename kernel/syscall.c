@@ -6,18 +6,20 @@
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
+#include "sysstat.h"
+#include "trace.h"
 
 typedef struct syscall_details
 {
   char *name;
-  int numArgs;
+  char *argtypes; // how to show each argument (trace.h)
 } syscall_details;
 
 // Fetch the uint64 at addr from the current process.
 int fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if (addr >= p->sz || addr + sizeof(uint64) > p->sz) // both tests needed, in case of overflow
+  if (addr >= p->mm->sz || addr + sizeof(uint64) > p->mm->sz) // both tests needed, in case of overflow
     return -1;
   if (copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
@@ -113,6 +115,26 @@ extern uint64 sys_sigreturn(void);
 /////////////////// IMPLEMENTED FOR SCHED TEST //////////////
 extern uint64 sys_waitx(void);
 ///////////////////////////////////////////////////////////
+extern uint64 sys_shmget(void);
+extern uint64 sys_shmat(void);
+extern uint64 sys_shmdt(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_join(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_ring_setup(void);
+extern uint64 sys_ring_enter(void);
+extern uint64 sys_sysstat(void);
+extern uint64 sys_evtrace(void);
+extern uint64 sys_profile(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_lockbench(void);
+extern uint64 sys_bstat(void);
+extern uint64 sys_bdrop(void);
 // extern uint64 sys_getyear(void);  // this is for testing purpose only, can be removed
 
 // An array mapping syscall numbers from syscall.h
@@ -147,8 +169,28 @@ static uint64 (*syscalls[])(void) = {
     [SYS_sigreturn]   sys_sigreturn,
     ////////////////////////////////////////////////////////
     ////////////////// IMPLEMENTED FOR SCHED TEST ////////////
-    [SYS_waitx] sys_waitx
+    [SYS_waitx] sys_waitx,
     //////////////////////////////////////////////////////////
+    [SYS_shmget] sys_shmget,
+    [SYS_shmat] sys_shmat,
+    [SYS_shmdt] sys_shmdt,
+    [SYS_mmap] sys_mmap,
+    [SYS_munmap] sys_munmap,
+    [SYS_fsync] sys_fsync,
+    [SYS_clone] sys_clone,
+    [SYS_join] sys_join,
+    [SYS_futex_wait] sys_futex_wait,
+    [SYS_futex_wake] sys_futex_wake,
+    [SYS_spawn] sys_spawn,
+    [SYS_ring_setup] sys_ring_setup,
+    [SYS_ring_enter] sys_ring_enter,
+    [SYS_sysstat] sys_sysstat,
+    [SYS_evtrace] sys_evtrace,
+    [SYS_profile] sys_profile,
+    [SYS_lockstat] sys_lockstat,
+    [SYS_lockbench] sys_lockbench,
+    [SYS_bstat] sys_bstat,
+    [SYS_bdrop] sys_bdrop,
 
     // [SYS_getyear] sys_getyear,
 };
@@ -185,67 +227,204 @@ syscall_details syscall_info[] = {
 
     //////////////////// IMPLEMENTED FOR SCHED TEST ////////////////
     [SYS_waitx].name = "waitx",
-    [SYS_waitx].numArgs = 0,
+    [SYS_waitx].argtypes = "ppp",
     ////////////////////////////////////////////////////////////////
 
-    [SYS_fork].numArgs = 0,
-    [SYS_exit].numArgs = 1,
-    [SYS_wait].numArgs = 1,
-    [SYS_pipe].numArgs = 1,
-    [SYS_read].numArgs = 3,
-    [SYS_kill].numArgs = 1,
-    [SYS_exec].numArgs = 2,
-    [SYS_fstat].numArgs = 2,
-    [SYS_chdir].numArgs = 1,
-    [SYS_dup].numArgs = 1,
-    [SYS_getpid].numArgs = 0,
-    [SYS_sbrk].numArgs = 1,
-    [SYS_sleep].numArgs = 1,
-    [SYS_uptime].numArgs = 0,
-    [SYS_open].numArgs = 2,
-    [SYS_write].numArgs = 3,
-    [SYS_mknod].numArgs = 3,
-    [SYS_unlink].numArgs = 1,
-    [SYS_link].numArgs = 2,
-    [SYS_mkdir].numArgs = 1,
-    [SYS_close].numArgs = 1,
-    [SYS_strace].numArgs = 1,
-    [SYS_settickets].numArgs = 1,
-    [SYS_set_priority].numArgs = 2,
+    [SYS_fork].argtypes = "",
+    [SYS_exit].argtypes = "i",
+    [SYS_wait].argtypes = "p",
+    [SYS_pipe].argtypes = "p",
+    [SYS_read].argtypes = "ipi",
+    [SYS_kill].argtypes = "i",
+    [SYS_exec].argtypes = "sp",
+    [SYS_fstat].argtypes = "ip",
+    [SYS_chdir].argtypes = "s",
+    [SYS_dup].argtypes = "i",
+    [SYS_getpid].argtypes = "",
+    [SYS_sbrk].argtypes = "i",
+    [SYS_sleep].argtypes = "i",
+    [SYS_uptime].argtypes = "",
+    [SYS_open].argtypes = "si",
+    [SYS_write].argtypes = "ipi",
+    [SYS_mknod].argtypes = "sii",
+    [SYS_unlink].argtypes = "s",
+    [SYS_link].argtypes = "ss",
+    [SYS_mkdir].argtypes = "s",
+    [SYS_close].argtypes = "i",
+    [SYS_strace].argtypes = "i",
+    [SYS_settickets].argtypes = "i",
+    [SYS_set_priority].argtypes = "ii",
     /////////////////// IMPLEMENTED FOR SIGALARM ///////////////
-    [SYS_sigalarm].numArgs = 2,
-    [SYS_sigreturn].numArgs = 0,
+    [SYS_sigalarm].argtypes = "ip",
+    [SYS_sigreturn].argtypes = "",
     ///////////////////////////////////////////////////////////
+
+    [SYS_shmget].name = "shmget",
+    [SYS_shmat].name = "shmat",
+    [SYS_shmdt].name = "shmdt",
+    [SYS_shmget].argtypes = "ii",
+    [SYS_shmat].argtypes = "i",
+    [SYS_shmdt].argtypes = "p",
+    [SYS_mmap].name = "mmap",
+    [SYS_munmap].name = "munmap",
+    [SYS_fsync].name = "fsync",
+    [SYS_mmap].argtypes = "piiiii",
+    [SYS_munmap].argtypes = "pi",
+    [SYS_fsync].argtypes = "i",
+    [SYS_clone].name = "clone",
+    [SYS_join].name = "join",
+    [SYS_clone].argtypes = "ppp",
+    [SYS_join].argtypes = "p",
+    [SYS_futex_wait].name = "futex_wait",
+    [SYS_futex_wake].name = "futex_wake",
+    [SYS_futex_wait].argtypes = "pii",
+    [SYS_futex_wake].argtypes = "pi",
+    [SYS_spawn].name = "spawn",
+    [SYS_spawn].argtypes = "spp",
+    [SYS_ring_setup].name = "ring_setup",
+    [SYS_ring_enter].name = "ring_enter",
+    [SYS_ring_setup].argtypes = "i",
+    [SYS_ring_enter].argtypes = "ii",
+    [SYS_sysstat].name = "sysstat",
+    [SYS_sysstat].argtypes = "pi",
+    [SYS_evtrace].name = "evtrace",
+    [SYS_evtrace].argtypes = "i",
+    [SYS_profile].name = "profile",
+    [SYS_profile].argtypes = "i",
+    [SYS_lockstat].name = "lockstat",
+    [SYS_lockstat].argtypes = "pi",
+    [SYS_lockbench].name = "lockbench",
+    [SYS_lockbench].argtypes = "i",
+    [SYS_bstat].name = "bstat",
+    [SYS_bstat].argtypes = "p",
+    [SYS_bdrop].name = "bdrop",
+    [SYS_bdrop].argtypes = "",
     
 };
 
-void prompt_strace(struct proc *p, int num)
+// Start p's trace record for a call to num,
+// with the arguments as they are on entry.
+static void
+tracebegin(struct proc *p, int num, struct tracerec *r)
 {
-  printf("%d: syscall %s (", p->pid, syscall_info[num].name);
-  int arg;
-  for (int i = 0; i < syscall_info[num].numArgs; i++)
+  char *types = syscall_info[num].argtypes;
+  int i, nstr = 0;
+
+  memset(r, 0, sizeof(*r));
+  r->start = r_time();
+  r->pid = p->pid;
+  r->num = num;
+  for (i = 0; types && types[i] && i < NTRACEARG; i++)
   {
-    argint(i, &arg);
-    if (i == syscall_info[num].numArgs - 1)
-      printf("%d", arg);
-    else
-      printf("%d ", arg);
+    r->types[i] = types[i];
+    r->args[i] = argraw(i);
+    if (types[i] == 's' && nstr < 2)
+    {
+      // a string too long for str is cut short.
+      if (fetchstr(r->args[i], r->str[nstr], TRACESTR) < 0)
+        r->str[nstr][TRACESTR - 1] = 0;
+      nstr++;
+    }
   }
-  printf(") -> %d\n", p->trapframe->a0);
-  return;
+}
+
+// Trace the current process's exit(status), if it traces
+// exit, since exit() never returns to finish the record.
+void traceexit(int status)
+{
+  struct proc *p = myproc();
+  struct tracerec r;
+
+  if (((p->strace_bit >> SYS_exit) & 1) == 0)
+    return;
+  tracebegin(p, SYS_exit, &r);
+  r.args[0] = status;
+  r.end = r.start;
+  tracepush(&r);
+}
+
+// Counts and latency histograms for each system call, kept
+// per CPU so that they need no lock; sysstatcopy() adds them up.
+// A call is counted on the CPU it returns on.
+struct cpusysstat {
+  uint64 count;
+  uint64 time;
+  uint64 hist[NSYSHIST];
+};
+
+static struct cpusysstat cpusysstat[NCPU][NELEM(syscalls)];
+
+// Count a call to num that took t time CSR counts.
+static void
+sysstatadd(int num, uint64 t)
+{
+  struct cpusysstat *st;
+  int b;
+
+  for (b = 0; b < NSYSHIST - 1 && (t >> (b + 1)) != 0; b++)
+    ;
+  push_off();
+  st = &cpusysstat[cpuid()][num];
+  st->count++;
+  st->time += t;
+  st->hist[b]++;
+  pop_off();
+}
+
+// Copy out the totals for system calls 0 to n-1, as
+// struct sysstats, to user address addr. Returns how
+// many system call numbers there are, or -1.
+int sysstatcopy(uint64 addr, int n)
+{
+  struct sysstat st;
+  int num, c, b;
+
+  if (n < 0)
+    return -1;
+  if (n > NELEM(syscalls))
+    n = NELEM(syscalls);
+  for (num = 0; num < n; num++)
+  {
+    memset(&st, 0, sizeof(st));
+    if (syscall_info[num].name)
+      safestrcpy(st.name, syscall_info[num].name, sizeof(st.name));
+    for (c = 0; c < NCPU; c++)
+    {
+      st.count += cpusysstat[c][num].count;
+      st.time += cpusysstat[c][num].time;
+      for (b = 0; b < NSYSHIST; b++)
+        st.hist[b] += cpusysstat[c][num].hist[b];
+    }
+    if (copyout(myproc()->pagetable, addr + num * sizeof(st), (char *)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return NELEM(syscalls);
 }
 
 void syscall(void)
 {
-  int num;
+  int num, traced;
+  uint64 start;
+  struct tracerec r;
   struct proc *p = myproc();
 
   num = p->trapframe->a7;
   if (num > 0 && num < NELEM(syscalls) && syscalls[num])
   {
+    traced = (p->strace_bit >> num) & 1;
+    if (traced)
+      tracebegin(p, num, &r);
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
+    start = r_time();
     p->trapframe->a0 = syscalls[num]();
+    sysstatadd(num, r_time() - start);
+    if (traced)
+    {
+      r.end = r_time();
+      r.ret = p->trapframe->a0;
+      tracepush(&r);
+    }
   }
   else
   {
@@ -253,9 +432,5 @@ void syscall(void)
     p->trapframe->a0 = -1;
   }
 
-  if (num > 0 && num < NELEM(syscalls) && syscalls[num] && ((p->strace_bit>>num) & 1))
-  {
-    prompt_strace(p, num);
-  }
   return;
 }
@@ -30,4 +30,24 @@
 /////////////////// IMPLEMENTED FOR SCHED TEST ///////////////
 #define SYS_waitx 27
 ///////////////////////////////////////////////////////////
+#define SYS_shmget 28
+#define SYS_shmat  29
+#define SYS_shmdt  30
+#define SYS_mmap   31
+#define SYS_munmap 32
+#define SYS_fsync  33
+#define SYS_clone  34
+#define SYS_join   35
+#define SYS_futex_wait 36
+#define SYS_futex_wake 37
+#define SYS_spawn  38
+#define SYS_ring_setup 39
+#define SYS_ring_enter 40
+#define SYS_sysstat 41
+#define SYS_evtrace 42
+#define SYS_profile 43
+#define SYS_lockstat 44
+#define SYS_lockbench 45
+#define SYS_bstat 46
+#define SYS_bdrop 47
 // #define SYS_getyear 23  // this is for testing purposes onyl, can be removed
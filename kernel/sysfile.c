@@ -15,9 +15,30 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "ring.h"
+
+// Return the file open as descriptor fd, with a reference
+// that the caller must drop with fileclose(), since another
+// thread may close the descriptor meanwhile. Returns 0 if fd
+// is not open.
+static struct file*
+fdget(int fd)
+{
+  struct file *f = 0;
+  struct mm *m = myproc()->mm;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  acquire(&m->lock);
+  if((f = m->ofile[fd]) != 0)
+    filedup(f);
+  release(&m->lock);
+  return f;
+}
 
 // Fetch the nth word-sized system call argument as a file descriptor
-// and return both the descriptor and the corresponding struct file.
+// and return both the descriptor and the corresponding struct file,
+// with a reference as from fdget().
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
@@ -25,12 +46,14 @@ argfd(int n, int *pfd, struct file **pf)
   struct file *f;
 
   argint(n, &fd);
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdget(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
   if(pf)
     *pf = f;
+  else
+    fileclose(f);
   return 0;
 }
 
@@ -40,17 +63,37 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *p = myproc();
+  struct mm *m = myproc()->mm;
 
+  acquire(&m->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
+    if(m->ofile[fd] == 0){
+      m->ofile[fd] = f;
+      release(&m->lock);
       return fd;
     }
   }
+  release(&m->lock);
   return -1;
 }
 
+// Free descriptor fd, if it still refers to f,
+// and drop its reference to f.
+static void
+fdfree(int fd, struct file *f)
+{
+  struct mm *m = myproc()->mm;
+
+  acquire(&m->lock);
+  if(m->ofile[fd] != f)
+    f = 0;
+  else
+    m->ofile[fd] = 0;
+  release(&m->lock);
+  if(f)
+    fileclose(f);
+}
+
 uint64
 sys_dup(void)
 {
@@ -59,9 +102,10 @@ sys_dup(void)
 
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -69,21 +113,23 @@ uint64
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
 
   argaddr(1, &p);
   argint(2, &n);
   if(argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  r = fileread(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
   
   argaddr(1, &p);
@@ -91,7 +137,9 @@ sys_write(void)
   if(argfd(0, 0, &f) < 0)
     return -1;
 
-  return filewrite(f, p, n);
+  r = filewrite(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
@@ -102,7 +150,7 @@ sys_close(void)
 
   if(argfd(0, &fd, &f) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
+  fdfree(fd, f);
   fileclose(f);
   return 0;
 }
@@ -112,11 +160,14 @@ sys_fstat(void)
 {
   struct file *f;
   uint64 st; // user pointer to struct stat
+  int r;
 
   argaddr(1, &st);
   if(argfd(0, 0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -301,18 +352,14 @@ create(char *path, short type, short major, short minor)
   return 0;
 }
 
-uint64
-sys_open(void)
+// Open path, for open() or a syscall ring.
+// Returns the new descriptor, or -1.
+static int
+kopen(char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
-  int n;
-
-  argint(1, &omode);
-  if((n = argstr(0, path, MAXPATH)) < 0)
-    return -1;
 
   begin_op();
 
@@ -341,9 +388,7 @@ sys_open(void)
     return -1;
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  if((f = filealloc()) == 0){
     iunlockput(ip);
     end_op();
     return -1;
@@ -367,9 +412,27 @@ sys_open(void)
   iunlock(ip);
   end_op();
 
+  // give f a descriptor only now that it is ready,
+  // since other threads may use it at once.
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int omode;
+
+  argint(1, &omode);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  return kopen(path, omode);
+}
+
 uint64
 sys_mkdir(void)
 {
@@ -410,7 +473,7 @@ uint64
 sys_chdir(void)
 {
   char path[MAXPATH];
-  struct inode *ip;
+  struct inode *ip, *old;
   struct proc *p = myproc();
   
   begin_op();
@@ -425,30 +488,30 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
+  acquire(&p->mm->lock);
+  old = p->mm->cwd;
+  p->mm->cwd = ip;
+  release(&p->mm->lock);
+  iput(old);
   end_op();
-  p->cwd = ip;
   return 0;
 }
 
-uint64
-sys_exec(void)
+// Copy in the user argv[] at uargv, into pages
+// that the caller frees with freeargv().
+static int
+fetchargv(uint64 uargv, char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
   int i;
-  uint64 uargv, uarg;
+  uint64 uarg;
 
-  argaddr(1, &uargv);
-  if(argstr(0, path, MAXPATH) < 0) {
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(char*));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
-      goto bad;
+    if(i >= MAXARG){
+      return -1;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
-      goto bad;
+      return -1;
     }
     if(uarg == 0){
       argv[i] = 0;
@@ -456,22 +519,67 @@ sys_exec(void)
     }
     argv[i] = kalloc();
     if(argv[i] == 0)
-      goto bad;
+      return -1;
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
-      goto bad;
+      return -1;
   }
+  return 0;
+}
 
-  int ret = exec(path, argv);
+static void
+freeargv(char **argv)
+{
+  int i;
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
+  for(i = 0; i < MAXARG && argv[i] != 0; i++)
     kfree(argv[i]);
+}
 
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
+  int ret;
+
+  argaddr(1, &uargv);
+  if(argstr(0, path, MAXPATH) < 0) {
+    return -1;
+  }
+  ret = -1;
+  if(fetchargv(uargv, argv) == 0)
+    ret = exec(path, argv);
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  struct spawnaction acts[MAXSPAWNACT];
+  uint64 uargv, uacts;
+  int n, ret;
+
+  argaddr(1, &uargv);
+  argaddr(2, &uacts);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  // the file actions, up to one with op 0.
+  for(n = 0; uacts != 0; n++){
+    if(n >= MAXSPAWNACT)
+      return -1;
+    if(copyin(myproc()->pagetable, (char*)&acts[n],
+              uacts + n*sizeof(acts[0]), sizeof(acts[0])) < 0)
+      return -1;
+    if(acts[n].op == 0)
+      break;
+  }
+  ret = -1;
+  if(fetchargv(uargv, argv) == 0)
+    ret = spawn(path, argv, acts, n);
+  freeargv(argv);
+  return ret;
 }
 
 uint64
@@ -485,21 +593,122 @@ sys_pipe(void)
   argaddr(0, &fdarray);
   if(pipealloc(&rf, &wf) < 0)
     return -1;
-  fd0 = -1;
-  if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-    if(fd0 >= 0)
-      p->ofile[fd0] = 0;
+  if((fd0 = fdalloc(rf)) < 0){
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
+  if((fd1 = fdalloc(wf)) < 0){
+    fdfree(fd0, rf);
+    fileclose(wf);
+    return -1;
+  }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
-    fileclose(rf);
-    fileclose(wf);
+    fdfree(fd0, rf);
+    fdfree(fd1, wf);
     return -1;
   }
   return 0;
 }
+
+uint64
+sys_mmap(void)
+{
+  int len, prot, flags, off;
+  struct file *f;
+  uint64 r;
+
+  // argument 0, the address, is only a hint, and is ignored.
+  argint(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  argint(5, &off);
+  if(argfd(4, 0, &f) < 0)
+    return -1;
+  r = mmap(len, prot, flags, f, off);
+  fileclose(f);
+  return r;
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr;
+  int len;
+
+  argaddr(0, &addr);
+  argint(1, &len);
+  if(len < 0)
+    return -1;
+  return munmap(addr, len);
+}
+
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+  int r;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  r = mmapsync(f);
+  fileclose(f);
+  return r;
+}
+
+// Carry out an operation submitted to a syscall ring, for
+// one of its workers (ring.c), as the system call would.
+int
+ringop(struct ringsqe *e)
+{
+  char path[MAXPATH];
+  struct file *f;
+  int r;
+
+  if(e->op == RING_OPEN){
+    if(fetchstr(e->addr, path, MAXPATH) < 0)
+      return -1;
+    return kopen(path, e->len);
+  }
+  if((f = fdget(e->fd)) == 0)
+    return -1;
+  switch(e->op){
+  case RING_READ:
+    r = fileread(f, e->addr, e->len);
+    break;
+  case RING_WRITE:
+    r = filewrite(f, e->addr, e->len);
+    break;
+  case RING_FSYNC:
+    r = mmapsync(f);
+    break;
+  case RING_CLOSE:
+    fdfree(e->fd, f);
+    r = 0;
+    break;
+  default:
+    r = -1;
+  }
+  fileclose(f);
+  return r;
+}
+
+uint64
+sys_ring_setup(void)
+{
+  int nworker;
+
+  argint(0, &nworker);
+  return ringsetup(nworker);
+}
+
+uint64
+sys_ring_enter(void)
+{
+  int submit, nwait;
+
+  argint(0, &submit);
+  argint(1, &nwait);
+  return ringenter(submit, nwait);
+}
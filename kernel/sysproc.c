@@ -42,8 +42,7 @@ sys_sbrk(void)
   int n;
 
   argint(0, &n);
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if(growproc(n, &addr) < 0)
     return -1;
   return addr;
 }
@@ -135,6 +134,7 @@ void restore(){
   p->trapframe_copy->kernel_hartid = p->trapframe->kernel_hartid;
   *(p->trapframe) = *(p->trapframe_copy);
   release(&p->lock);
+  fprestore(p, &p->fpstate_copy);
 }
 
 uint64 sys_sigreturn(void){
@@ -162,6 +162,142 @@ sys_waitx(void)
 }
 ////////////////////////////////////////////////////////////////
 
+uint64
+sys_shmget(void)
+{
+  int key, size;
+
+  argint(0, &key);
+  argint(1, &size);
+  return shmget(key, size);
+}
+
+uint64
+sys_shmat(void)
+{
+  int id;
+
+  argint(0, &id);
+  return shmat(id);
+}
+
+uint64
+sys_shmdt(void)
+{
+  uint64 addr;
+
+  argaddr(0, &addr);
+  return shmdt(addr);
+}
+
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  argaddr(0, &fn);
+  argaddr(1, &arg);
+  argaddr(2, &stack);
+  return clone(fn, arg, stack);
+}
+
+uint64
+sys_join(void)
+{
+  uint64 stack;
+
+  argaddr(0, &stack);
+  return join(stack);
+}
+
+uint64
+sys_futex_wait(void)
+{
+  uint64 addr;
+  int val, timeout;
+
+  argaddr(0, &addr);
+  argint(1, &val);
+  argint(2, &timeout);
+  return futexwait(addr, val, timeout);
+}
+
+uint64
+sys_futex_wake(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return futexwake(addr, n);
+}
+
+uint64
+sys_sysstat(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return sysstatcopy(addr, n);
+}
+
+uint64
+sys_evtrace(void)
+{
+  int mask;
+
+  argint(0, &mask);
+  return evtrace(mask);
+}
+
+uint64
+sys_profile(void)
+{
+  int on;
+
+  argint(0, &on);
+  return profile(on);
+}
+
+uint64
+sys_lockstat(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return lockstatcopy(addr, n);
+}
+
+uint64
+sys_lockbench(void)
+{
+  int ms;
+
+  argint(0, &ms);
+  return lockbench(ms);
+}
+
+uint64
+sys_bstat(void)
+{
+  uint64 addr;
+
+  argaddr(0, &addr);
+  return bstatcopy(addr);
+}
+
+uint64
+sys_bdrop(void)
+{
+  bdrop();
+  return 0;
+}
+
 // uint64
 // sys_getyear(void) // this is for testing purpose only, can be removed
 // {
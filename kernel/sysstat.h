@@ -0,0 +1,15 @@
+// System call counts and latencies, read with sysstat() (syscall.c).
+
+#define NSYSHIST 32  // latency histogram buckets
+
+// For one system call number, since boot. Times are in time
+// CSR counts (TIMEBASE per second, vdso.h); hist[i] counts the
+// calls that took from 2^i to 2^(i+1)-1 of them (hist[0] also
+// those that took none), and the last bucket all longer ones.
+// exit() is not counted, since it does not return.
+struct sysstat {
+  char name[16];
+  uint64 count;
+  uint64 time;      // total
+  uint64 hist[NSYSHIST];
+};
@@ -0,0 +1,117 @@
+//
+// The trace device: system call records for strace.
+//
+// syscall() (syscall.c) fills in a struct tracerec for each call
+// a process traces, and tracepush() copies it into this CPU's
+// ring, with interrupts off and no lock, overwriting the oldest
+// record if the ring is full; that is all tracing costs the
+// traced process. Reading the device takes records out of the
+// rings, waiting for a clock tick at a time until there are
+// some. Records from each CPU come in order, but one CPU's may
+// come before earlier ones of another's.
+//
+// A reader copies a record and then checks that the CPU has
+// not since begun to overwrite it. Readers take turns under
+// tracelk, and keep the place they have read up to in tail.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "defs.h"
+#include "trace.h"
+
+#define NTRACE 64     // records in each CPU's ring
+
+struct tracering {
+  uint head;          // records pushed; written only by this CPU
+  uint tail;          // records read or lost; under tracelk
+  struct tracerec rec[NTRACE];
+};
+
+static struct tracering traces[NCPU];
+static struct sleeplock tracelk;
+
+// Add r to this CPU's ring.
+void
+tracepush(struct tracerec *r)
+{
+  struct tracering *t;
+
+  push_off();
+  t = &traces[cpuid()];
+  t->rec[t->head % NTRACE] = *r;
+  __sync_synchronize();
+  t->head++;
+  pop_off();
+}
+
+// Take the next record from t, if there is one, into *r.
+// Returns 1 if there was, 0 if not. Caller holds tracelk.
+static int
+tracepop(struct tracering *t, struct tracerec *r)
+{
+  uint head, lost = 0;
+
+  for(;;){
+    head = t->head;
+    if(t->tail == head)
+      return 0;
+    if(head - t->tail > NTRACE){
+      lost += head - NTRACE - t->tail;
+      t->tail = head - NTRACE;
+    }
+    __sync_synchronize();
+    *r = t->rec[t->tail % NTRACE];
+    __sync_synchronize();
+    // did the CPU start to overwrite the record as we copied it?
+    if(t->head - t->tail < NTRACE)
+      break;
+    lost++;
+    t->tail++;
+  }
+  t->tail++;
+  r->lost = lost;
+  return 1;
+}
+
+// Read whole records into dst, waiting until there is at least one.
+static int
+traceread(int user_dst, uint64 dst, int n)
+{
+  struct tracerec r;
+  int c, got = 0;
+
+  acquiresleep(&tracelk);
+  for(;;){
+    for(c = 0; c < NCPU; c++){
+      while(n - got >= sizeof(r) && tracepop(&traces[c], &r)){
+        if(either_copyout(user_dst, dst + got, &r, sizeof(r)) < 0){
+          releasesleep(&tracelk);
+          return got > 0 ? got : -1;
+        }
+        got += sizeof(r);
+      }
+    }
+    if(got > 0 || n < sizeof(r) || killed(myproc()))
+      break;
+    acquire(&tickslock);
+    sleep(&ticks, &tickslock);
+    release(&tickslock);
+  }
+  releasesleep(&tracelk);
+  return got > 0 ? got : -1;
+}
+
+void
+traceinit(void)
+{
+  initsleeplock(&tracelk, "trace");
+  devsw[TRACE].read = traceread;
+}
@@ -0,0 +1,24 @@
+// System call trace records, read from the trace
+// device (trace.c) by strace.
+
+#define NTRACEARG 6   // most arguments in a record
+#define TRACESTR 32   // bytes kept of each string argument
+
+// One traced system call. types[i] says how to show args[i]:
+// 'i' an int, 'p' a pointer, 's' a string, whose first bytes
+// are in str[], in order, for the first two; 0 past the last.
+// Times are time CSR counts. lost is how many records this
+// CPU's ring dropped just before this one, as the reader fell
+// behind. exit() makes a record as it starts, with ret 0.
+struct tracerec {
+  uint64 start;
+  uint64 end;
+  int pid;
+  short num;            // system call number
+  char types[NTRACEARG];
+  uint64 args[NTRACEARG];
+  uint64 ret;
+  uint lost;
+  uint pad;
+  char str[2][TRACESTR];
+};
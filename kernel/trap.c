@@ -5,11 +5,13 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "event.h"
 
 struct spinlock tickslock;
 uint ticks;
 
 extern char trampoline[], uservec[], userret[];
+extern char usercopy[], usercopyfault[], usercopyend[];
 
 // in kernelvec.S, calls kerneltrap().
 void kernelvec();
@@ -44,8 +46,12 @@ void usertrap(void)
 
   struct proc *p = myproc();
 
+  // No RCU reader can be on this hart, coming from user space.
+  rcuquiesce(mycpu());
+
   // save user program counter.
   p->trapframe->epc = r_sepc();
+  TRACEPOINT(EVC_TRAP, EV_TRAP, r_scause(), p->trapframe->epc);
 
   if (r_scause() == 8)
   {
@@ -68,6 +74,17 @@ void usertrap(void)
   {
     // ok
   }
+  else if ((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+           uvmfault(p->pagetable, r_stval()) == 0)
+  {
+    // page fault on a swapped-out page, now read back in,
+    // or on a page of a file mapping, now mapped.
+  }
+  else if (r_scause() == 2 && fptrap(p) == 0)
+  {
+    // first FP instruction since p last had this
+    // hart's FP registers, now loaded.
+  }
   else
   {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
@@ -123,6 +140,11 @@ void usertrap(void)
         p->trapframe_copy->t4 = p->trapframe->t4;
         p->trapframe_copy->t5 = p->trapframe->t5;
         p->trapframe_copy->t6 = p->trapframe->t6;
+        fpsave(p, &p->fpstate_copy);
+        // the handler gets the interrupted pc in tp, which user
+        // code does not otherwise use, so that it can resume the
+        // thread itself rather than through sigreturn().
+        p->trapframe->tp = p->trapframe->epc;
         p->trapframe->epc = p->sig_handler;
 
         p->alarm_is_set = 1;
@@ -154,6 +176,12 @@ void usertrapret(void)
   uint64 trampoline_uservec = TRAMPOLINE + (uservec - trampoline);
   w_stvec(trampoline_uservec);
 
+  // p may have been given a new ASID during the trap.
+  kvmactivate(p);
+  // no stale TLB entries of p's are left on this hart
+  // (mmquiesce()), even if p never gives it up.
+  __atomic_fetch_add(&p->nsched, 1, __ATOMIC_RELEASE);
+
   // set up trapframe values that uservec will need when
   // the process next traps into the kernel.
   p->trapframe->kernel_satp = r_satp();         // kernel page table
@@ -168,19 +196,23 @@ void usertrapret(void)
   unsigned long x = r_sstatus();
   x &= ~SSTATUS_SPP; // clear SPP to 0 for user mode
   x |= SSTATUS_SPIE; // enable interrupts in user mode
+  x &= ~SSTATUS_FS;  // FP instructions trap, unless the
+  x |= fpuserfs(p);  // FP registers are already p's
   w_sstatus(x);
 
   // set S Exception Program Counter to the saved user pc.
   w_sepc(p->trapframe->epc);
 
-  // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  // tell trampoline.S the user page table to switch to,
+  // and the ASID that tags its TLB entries, the same
+  // as for p's kernel page table.
+  uint64 satp = MAKE_SATP(p->pagetable) | (r_satp() & SATP_ASID_MASK);
 
   // jump to userret in trampoline.S at the top of memory, which
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 trampoline_userret = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64))trampoline_userret)(satp);
+  ((void (*)(uint64, uint64))trampoline_userret)(satp, p->trapframeva);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -197,7 +229,21 @@ void kerneltrap()
   if (intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
-  if ((which_dev = devintr()) == 0)
+  // the trap may have come in the middle of copyfast(), with
+  // sstatus.SUM set. don't let it stay set for whatever this
+  // hart runs if we yield(); the w_sstatus() at the end puts
+  // it back for the interrupted copy.
+  w_sstatus(sstatus & ~SSTATUS_SUM);
+
+  if ((scause == 13 || scause == 15) &&
+      sepc >= (uint64)usercopy && sepc < (uint64)usercopyend)
+  {
+    // a page fault in copyin()/copyout()'s direct copy
+    // of user memory; make the copy fail, so that they
+    // fall back to walking the page table.
+    sepc = (uint64)usercopyfault;
+  }
+  else if ((which_dev = devintr()) == 0)
   {
     printf("scause %p\n", scause);
     printf("sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -230,6 +276,7 @@ void clockintr()
 {
   acquire(&tickslock);
   ticks++;
+  vdsotick();
   /////////////// IMPLEMENTED FOR SCHEDULER TESTING ///////////////////
   update_time();
   ////////////////////////////////////////////////////////////////
@@ -282,6 +329,9 @@ int devintr()
     // software interrupt from a machine-mode timer interrupt,
     // forwarded by timervec in kernelvec.S.
 
+    // sepc is still the pc it interrupted.
+    profsample(r_sepc());
+
     if (cpuid() == 0)
     {
       clockintr();
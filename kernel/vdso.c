@@ -0,0 +1,83 @@
+//
+// The vDSO: read-only pages mapped into every process, so that
+// user code can read the clock and its pid without trapping.
+//
+// VDSO is one page shared by all processes, with ticks and what
+// user code needs to turn the time CSR, which start.c lets it
+// read, into nanoseconds. The clock interrupt updates it under
+// a sequence count (vdso.h). VDSOPROC is a page for each mm,
+// allocated with it, holding the pid.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "vdso.h"
+
+static struct vdso *vdso;
+
+void
+vdsoinit(void)
+{
+  if((vdso = (struct vdso*)kalloc()) == 0)
+    panic("vdsoinit");
+  memset(vdso, 0, PGSIZE);
+  vdso->nsmult = (1000000000ULL << NSSHIFT) / TIMEBASE;
+  vdso->cycles = r_time();
+  vdso->ns = (vdso->cycles * vdso->nsmult) >> NSSHIFT;
+}
+
+// Called by clockintr(), with tickslock held, after ticks changes.
+void
+vdsotick(void)
+{
+  uint64 t = r_time();
+
+  vdso->seq++;
+  __sync_synchronize();
+  vdso->ticks = ticks;
+  vdso->ns += ((t - vdso->cycles) * vdso->nsmult) >> NSSHIFT;
+  vdso->cycles = t;
+  __sync_synchronize();
+  vdso->seq++;
+}
+
+// Allocate the VDSOPROC page for a new mm,
+// holding pid. Returns 0 if out of memory.
+struct vdsoproc*
+vdsoprocalloc(int pid)
+{
+  struct vdsoproc *vp;
+
+  if((vp = (struct vdsoproc*)kalloc()) == 0)
+    return 0;
+  memset(vp, 0, PGSIZE);
+  vp->pid = pid;
+  return vp;
+}
+
+// Map the vDSO pages, with m's VDSOPROC page,
+// into pagetable. Returns 0, or -1.
+int
+vdsomap(pagetable_t pagetable, struct mm *m)
+{
+  if(mappages(pagetable, VDSO, PGSIZE, (uint64)vdso, PTE_R | PTE_U) < 0)
+    return -1;
+  if(mappages(pagetable, VDSOPROC, PGSIZE, (uint64)m->vdsoproc, PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, VDSO, 1, 0);
+    return -1;
+  }
+  return 0;
+}
+
+// Unmap the vDSO pages from pagetable, without freeing them.
+void
+vdsounmap(pagetable_t pagetable)
+{
+  uvmunmap(pagetable, VDSO, 1, 0);
+  uvmunmap(pagetable, VDSOPROC, 1, 0);
+}
@@ -0,0 +1,23 @@
+// The vDSO pages, which every process can read without
+// a system call (vdso.c, and uptime() and getpid() in ulib.c).
+
+#define TIMEBASE 10000000  // time CSR counts per second, on qemu virt
+#define NSSHIFT  24        // fraction bits in vdso.nsmult
+
+// At VDSO, the same page for all processes. Written only by the
+// clock interrupt; seq is odd while it does, and readers retry
+// if seq was odd or changed while they read. ticks alone may
+// be read without looking at seq.
+struct vdso {
+  uint seq;
+  uint ticks;        // as uptime() returns
+  uint64 cycles;     // time CSR at the last clock interrupt
+  uint64 ns;         // nanoseconds since boot at cycles
+  uint64 nsmult;     // ns per time CSR count, << NSSHIFT
+};
+
+// At VDSOPROC, a page for each process.
+struct vdsoproc {
+  int pid;           // as getpid() returns, or 0 if the
+                     // process has threads, with pids of their own
+};
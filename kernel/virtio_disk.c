@@ -15,6 +15,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "event.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -46,7 +47,9 @@ static struct disk {
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    int *busy;    // cleared, and woken up, when the operation is done.
+    struct buf *b; // for a read-ahead, which nobody waits for.
+    uint64 sector;
     char status;
   } info[NUM];
 
@@ -212,26 +215,19 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// hand the device a request, in the three descriptors idx,
+// to read or write len bytes at data from or to the disk,
+// starting at sector. *busy is set while it is in flight.
+// b is the buf of a read-ahead, or 0.
+// caller holds disk.vdisk_lock.
+static void
+disk_start(int *idx, uint64 sector, void *data, uint len, int write,
+           int *busy, struct buf *b)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
-
   // the spec's Section 5.2 says that legacy block operations use
   // three descriptors: one for type/reserved/sector, one for the
   // data, one for a 1-byte status result.
 
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
-
   // format the three descriptors.
   // qemu's virtio-blk.c reads them.
 
@@ -249,12 +245,12 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
+  disk.desc[idx[1]].addr = (uint64) data;
+  disk.desc[idx[1]].len = len;
   if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
+    disk.desc[idx[1]].flags = 0; // device reads data
   else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
+    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes data
   disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
   disk.desc[idx[1]].next = idx[2];
 
@@ -264,9 +260,12 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
   disk.desc[idx[2]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
+  // record the busy flag for virtio_disk_intr().
+  *busy = 1;
+  disk.info[idx[0]].busy = busy;
   disk.info[idx[0]].b = b;
+  disk.info[idx[0]].sector = sector;
+  TRACEPOINT(EVC_DISK, EV_DISKSTART, sector, write);
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -279,18 +278,75 @@ virtio_disk_rw(struct buf *b, int write)
   __sync_synchronize();
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
+
+// read or write len bytes at data from or to the disk,
+// starting at sector, and wait for the operation to finish.
+// *busy is set while the operation is in flight.
+static void
+disk_rw(uint64 sector, void *data, uint len, int write, int *busy)
+{
+  int idx[3];
+
+  acquire(&disk.vdisk_lock);
+
+  // allocate the three descriptors.
+  while(1){
+    if(alloc3_desc(idx) == 0) {
+      break;
+    }
+    sleep(&disk.free[0], &disk.vdisk_lock);
+  }
+
+  disk_start(idx, sector, data, len, write, busy, 0);
 
   // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+  while(*busy == 1) {
+    sleep(busy, &disk.vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
+  disk.info[idx[0]].busy = 0;
   free_chain(idx[0]);
 
   release(&disk.vdisk_lock);
 }
 
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  disk_rw(b->blockno * (BSIZE / 512), b->data, BSIZE, write, &b->disk);
+}
+
+// start reading b from the disk, for read-ahead, without
+// waiting; virtio_disk_intr() hands b to bdone() once it has
+// its data. returns -1, having started nothing, if the disk
+// has no room for another request.
+int
+virtio_disk_start(struct buf *b)
+{
+  int idx[3];
+
+  acquire(&disk.vdisk_lock);
+  if(alloc3_desc(idx) != 0){
+    release(&disk.vdisk_lock);
+    return -1;
+  }
+  disk_start(idx, b->blockno * (BSIZE / 512), b->data, BSIZE, 0, &b->disk, b);
+  release(&disk.vdisk_lock);
+  return 0;
+}
+
+// read or write the page at physical address pa from or to
+// the PGSIZE/BSIZE disk blocks starting at blockno,
+// in a single request. used for swapping.
+void
+virtio_disk_rwpage(uint blockno, void *pa, int write)
+{
+  int busy;
+
+  disk_rw((uint64)blockno * (BSIZE / 512), pa, PGSIZE, write, &busy);
+}
+
 void
 virtio_disk_intr()
 {
@@ -316,9 +372,19 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
+    TRACEPOINT(EVC_DISK, EV_DISKDONE, disk.info[id].sector, 0);
+    int *busy = disk.info[id].busy;
     struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    *busy = 0;   // disk is done with the data
+    if(b){
+      // a read-ahead: nobody waits in disk_rw() to clean up.
+      disk.info[id].busy = 0;
+      disk.info[id].b = 0;
+      free_chain(id);
+      bdone(b);
+    } else {
+      wakeup(busy);
+    }
 
     disk.used_idx += 1;
   }
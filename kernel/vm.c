@@ -5,6 +5,8 @@
 #include "riscv.h"
 #include "defs.h"
 #include "fs.h"
+#include "spinlock.h"
+#include "proc.h"
 
 /*
  * the kernel's page table.
@@ -70,6 +72,225 @@ kvminithart()
   sfence_vma();
 }
 
+// Address-space identifiers.
+//
+// Each user page table is run with an ASID in satp, so that
+// switching between the kernel and user page tables in
+// trampoline.S does not have to flush the TLB.
+// ASIDs are handed out in order from a counter. When the
+// counter runs past the largest ASID the hart implements,
+// a new generation starts: every hart flushes its whole TLB
+// once before running any ASID of the new generation, and
+// processes holding an ASID of an old generation get a fresh
+// one on their next return to user space. An ASID is never
+// handed out twice within a generation, so exited processes
+// need no flush.
+// ASID 0 belongs to the kernel page table. On harts without
+// ASIDs every process runs with ASID 0, and trampoline.S
+// flushes the TLB on each switch, as it always used to.
+
+#define ASIDBITS 16
+#define ASIDMASK ((1L << ASIDBITS) - 1)
+
+// Changes to more pages than this flush the whole ASID
+// rather than one page at a time.
+#define MAXFLUSHPAGES 32
+
+struct {
+  struct spinlock lock;
+  uint64 generation;  // current generation, in the bits above ASIDBITS
+  uint64 next;        // next unused ASID of this generation
+  uint64 max;         // largest ASID the hart implements; 0 if none
+} asids;
+
+// Find out how many ASID bits the hart implements
+// by writing ones to satp's ASID field and seeing
+// which of them stick. Paging must already be on.
+void
+asidinit(void)
+{
+  initlock(&asids.lock, "asid");
+  w_satp(MAKE_SATP(kernel_pagetable) | SATP_ASID_MASK);
+  asids.max = (r_satp() & SATP_ASID_MASK) >> SATP_ASID_SHIFT;
+  w_satp(MAKE_SATP(kernel_pagetable));
+  sfence_vma();
+  asids.generation = 1L << ASIDBITS;
+  asids.next = 1;
+}
+
+// Return the ASID with which to run p's page tables
+// on this hart, allocating one if p holds none from the
+// current generation. Flushes this hart's TLB if it has
+// not done so since the generation started.
+// Interrupts must be disabled.
+static uint64
+asidactivate(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  uint64 gen;
+
+  if(asids.max == 0)
+    return 0;
+
+  gen = __atomic_load_n(&asids.generation, __ATOMIC_ACQUIRE);
+  if((p->mm->asid & ~ASIDMASK) != gen || c->asidgen != gen){
+    acquire(&asids.lock);
+    if(c->asidgen != asids.generation){
+      sfence_vma();
+      c->asidgen = asids.generation;
+    }
+    if((p->mm->asid & ~ASIDMASK) != asids.generation){
+      if(asids.next > asids.max){
+        // out of ASIDs; start a new generation,
+        // beginning with this hart.
+        asids.generation += 1L << ASIDBITS;
+        asids.next = 1;
+        sfence_vma();
+        c->asidgen = asids.generation;
+      }
+      p->mm->asid = asids.generation | asids.next++;
+      p->mm->tlbharts = 0;
+      // order this hart's earlier page-table writes
+      // before walks made under the new ASID.
+      sfence_vma_asid(p->mm->asid & ASIDMASK);
+    }
+    release(&asids.lock);
+  }
+  // the mm's other threads may be activating it on other harts.
+  __atomic_fetch_or(&p->mm->tlbharts, 1L << cpuid(), __ATOMIC_RELAXED);
+  return p->mm->asid & ASIDMASK;
+}
+
+// Make changes to the PTEs of npages of p's user memory,
+// starting at va, take effect. If no other hart can hold
+// translations for p's ASID, flush just those pages here.
+// Otherwise give up the ASID, so that p gets a fresh one
+// (that no TLB has seen) on its next return to user space.
+// Called by p itself, or with p->lock held while p is
+// not running.
+void
+uvmflush(struct proc *p, uint64 va, uint64 npages)
+{
+  uint64 asid, i;
+
+  push_off();
+  asid = p->mm->asid & ASIDMASK;
+  if(asids.max == 0 || p->mm->asid == 0){
+    // nothing of p's can be cached under an ASID;
+    // the next switch to the page table will flush.
+  } else if(p->mm->tlbharts == (1L << cpuid())){
+    if(npages > MAXFLUSHPAGES){
+      sfence_vma_asid(asid);
+    } else {
+      for(i = 0; i < npages; i++)
+        sfence_vma_page(va + i*PGSIZE, asid);
+    }
+  } else {
+    // this hart may be running p's kernel page
+    // table under the old ASID; flush it here too.
+    sfence_vma_asid(asid);
+    p->mm->asid = 0;
+    p->mm->tlbharts = 0;
+  }
+  pop_off();
+}
+
+// Per-process kernel page tables.
+//
+// A process runs in the kernel on a page table of its own,
+// in which its user memory appears at the same addresses as
+// in its user page table, so that copyin() and copyout() can
+// use plain loads and stores. The table is a copy of the
+// kernel's root page, except that entry 0 points to a private
+// level-1 page. Its entries for the user memory below USERTOP
+// point at the same level-0 page-table pages as the user page
+// table's (so user mappings show up without copying), and the
+// rest, for the devices, point at the kernel's.
+// kvmsync() must be called after the user page table gains
+// level-0 pages, which happens only as memory grows.
+// The kernel and user page tables of a process are run with
+// the same ASID: where both map an address, they map it alike.
+
+// Make a kernel page table for a process with no user memory.
+// Returns 0 if out of memory.
+pagetable_t
+kvmcreate(void)
+{
+  pagetable_t kpt, l1;
+  uint64 i;
+
+  if((kpt = (pagetable_t) kalloc()) == 0)
+    return 0;
+  if((l1 = (pagetable_t) kalloc()) == 0){
+    kfree(kpt);
+    return 0;
+  }
+  memmove(kpt, kernel_pagetable, PGSIZE);
+  memmove(l1, (void*)PTE2PA(kernel_pagetable[0]), PGSIZE);
+  for(i = 0; i < PX(1, USERTOP); i++)
+    l1[i] = 0;
+  kpt[0] = PA2PTE(l1) | PTE_V;
+  return kpt;
+}
+
+// Point kpt's user entries at the level-0 pages of
+// user page table upt.
+void
+kvmsync(pagetable_t kpt, pagetable_t upt)
+{
+  pagetable_t l1, ul1;
+  uint64 i;
+  int changed = 0;
+
+  l1 = (pagetable_t) PTE2PA(kpt[0]);
+  ul1 = (upt[0] & PTE_V) ? (pagetable_t) PTE2PA(upt[0]) : 0;
+  for(i = 0; i < PX(1, USERTOP); i++){
+    pte_t pte = ul1 ? ul1[i] : 0;
+    if(l1[i] != pte){
+      l1[i] = pte;
+      changed = 1;
+    }
+  }
+  if(changed)
+    sfence_vma();
+}
+
+// Free a kernel page table made by kvmcreate().
+// The level-0 pages belong to the user and
+// kernel page tables, and are not freed.
+void
+kvmfree(pagetable_t kpt)
+{
+  kfree((void*)PTE2PA(kpt[0]));
+  kfree((void*)kpt);
+}
+
+// Switch this hart to p's kernel page table.
+// Interrupts must be disabled.
+void
+kvmactivate(struct proc *p)
+{
+  uint64 asid, satp;
+
+  asid = asidactivate(p);
+  satp = MAKE_SATP_ASID(p->kpagetable, asid);
+  if(r_satp() != satp){
+    w_satp(satp);
+    if(asid == 0)
+      sfence_vma();
+  }
+}
+
+// Switch this hart back to the kernel's own page table,
+// before the process's may be freed.
+void
+kvmdeactivate(void)
+{
+  w_satp(MAKE_SATP(kernel_pagetable));
+  if(asids.max == 0)
+    sfence_vma();
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -102,6 +323,41 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   return &pagetable[PX(0, va)];
 }
 
+// A cursor for visiting the PTEs of a run of pages in order.
+// It remembers the level-0 page-table page that its last walk
+// ended in, and walks from the root again only when va leaves
+// the range that page maps, i.e. once per 512 pages.
+struct ptecursor {
+  pagetable_t pagetable;
+  pagetable_t l0;      // level-0 page of the last walk, or 0
+  uint64 base;         // first va that l0 maps
+};
+
+#define L0SPAN (512L * PGSIZE)  // bytes mapped by a level-0 page
+
+static void
+cursorinit(struct ptecursor *c, pagetable_t pagetable)
+{
+  c->pagetable = pagetable;
+  c->l0 = 0;
+}
+
+// Return the PTE for va, like walk().
+static pte_t *
+cursorwalk(struct ptecursor *c, uint64 va, int alloc)
+{
+  pte_t *pte;
+
+  if(c->l0 == 0 || va < c->base || va - c->base >= L0SPAN){
+    if((pte = walk(c->pagetable, va, alloc)) == 0)
+      return 0;
+    c->l0 = (pagetable_t) PGROUNDDOWN((uint64)pte);
+    c->base = va & ~(L0SPAN - 1);
+    return pte;
+  }
+  return &c->l0[PX(0, va)];
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -144,14 +400,16 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
   uint64 a, last;
   pte_t *pte;
+  struct ptecursor c;
 
   if(size == 0)
     panic("mappages: size");
   
+  cursorinit(&c, pagetable);
   a = PGROUNDDOWN(va);
   last = PGROUNDDOWN(va + size - 1);
   for(;;){
-    if((pte = walk(pagetable, a, 1)) == 0)
+    if((pte = cursorwalk(&c, a, 1)) == 0)
       return -1;
     if(*pte & PTE_V)
       panic("mappages: remap");
@@ -166,29 +424,51 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 
 // Remove npages of mappings starting from va. va must be
 // page-aligned. The mappings must exist.
-// Optionally free the physical memory.
-void
-uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
+// With do_free, return the physical pages, chained
+// through their first words, for kfreechain().
+static void*
+unmapchain(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
   uint64 a;
   pte_t *pte;
+  struct ptecursor c;
+  void *freed = 0;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
+  cursorinit(&c, pagetable);
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
+    if((pte = cursorwalk(&c, a, 0)) == 0)
       panic("uvmunmap: walk");
+    if(*pte & PTE_S){
+      // swapped out; the page lives only in its swap slot.
+      if(do_free)
+        swapfree(*pte);
+      *pte = 0;
+      continue;
+    }
     if((*pte & PTE_V) == 0)
       panic("uvmunmap: not mapped");
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
-      uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
+      // chain the page onto freed through its first word.
+      void *pa = (void*)PTE2PA(*pte);
+      *(void**)pa = freed;
+      freed = pa;
     }
     *pte = 0;
   }
+  return freed;
+}
+
+// Remove npages of mappings starting from va, as unmapchain().
+// Optionally free the physical memory, in one batch.
+void
+uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
+{
+  kfreechain(unmapchain(pagetable, va, npages, do_free));
 }
 
 // create an empty user page table.
@@ -227,23 +507,31 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 {
   char *mem;
   uint64 a;
+  pte_t *pte;
+  struct ptecursor c;
 
   if(newsz < oldsz)
     return oldsz;
+  if(newsz > MMAPBASE)
+    return 0;
 
+  cursorinit(&c, pagetable);
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = swapkalloc();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
     memset(mem, 0, PGSIZE);
-    if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
+    if((pte = cursorwalk(&c, a, 1)) == 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
+    if(*pte & (PTE_V|PTE_S))
+      panic("uvmalloc: remap");
+    *pte = PA2PTE(mem) | PTE_R | PTE_U | xperm | PTE_V;
   }
   return newsz;
 }
@@ -255,15 +543,20 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 uint64
 uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
-  if(newsz >= oldsz)
-    return oldsz;
-
-  if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
-    int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
-    uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
-  }
+  kfreechain(uvmshrink(pagetable, oldsz, newsz));
+  return newsz < oldsz ? newsz : oldsz;
+}
 
-  return newsz;
+// Like uvmdealloc(), but return the pages instead of freeing
+// them, chained for kfreechain(), so that the caller can first
+// make sure that no TLB still maps them.
+void*
+uvmshrink(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
+{
+  if(newsz >= oldsz || PGROUNDUP(newsz) >= PGROUNDUP(oldsz))
+    return 0;
+  return unmapchain(pagetable, PGROUNDUP(newsz),
+                    (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE, 1);
 }
 
 // Recursively free page-table pages.
@@ -305,25 +598,43 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
+  pte_t *pte, *npte;
   uint64 pa, i;
   uint flags;
   char *mem;
+  struct ptecursor oc, nc;
 
+  cursorinit(&oc, old);
+  cursorinit(&nc, new);
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
-    pa = PTE2PA(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    // allocate first: making room may swap out
+    // the very page that is to be copied.
+    if((mem = swapkalloc()) == 0)
       goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
+    // and keep the clock away from old's page until
+    // it has been copied.
+    myproc()->pinned++;
+    if((pte = cursorwalk(&oc, i, 0)) == 0)
+      panic("uvmcopy: pte should exist");
+    if(*pte & PTE_S){
+      // the child gets a resident copy.
+      flags = (PTE_FLAGS(*pte) & ~PTE_S) | PTE_V;
+      swapread(*pte, mem);
+    } else {
+      if((*pte & PTE_V) == 0)
+        panic("uvmcopy: page not present");
+      pa = PTE2PA(*pte);
+      flags = PTE_FLAGS(*pte);
+      memmove(mem, (char*)pa, PGSIZE);
+    }
+    uvmunpin();
+    if((npte = cursorwalk(&nc, i, 1)) == 0){
       kfree(mem);
       goto err;
     }
+    if(*npte & PTE_V)
+      panic("uvmcopy: remap");
+    *npte = PA2PTE(mem) | flags;
   }
   return 0;
 
@@ -332,6 +643,143 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   return -1;
 }
 
+// Handle a page fault at user virtual address va in pagetable,
+// from usertrap() or from copyin()/copyout(): read the page
+// back in if it was swapped out, map it if it belongs to a
+// file mapping, or set the PTE_A and PTE_D bits for harts
+// that fault rather than set them themselves.
+// Returns 0 if the access should be retried, -1 if va is
+// not mapped for the user.
+int
+uvmfault(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || *pte == 0){
+    // not mapped yet; perhaps a page of a file mapping.
+    if(p == 0 || pagetable != p->pagetable || mmapfault(p, va) < 0)
+      return -1;
+  } else if(*pte & PTE_S){
+    if(swapin(pagetable, va) < 0)
+      return -1;
+  } else if((*pte & (PTE_V|PTE_U)) == (PTE_V|PTE_U) &&
+            ((*pte & PTE_A) == 0 || ((*pte & PTE_W) && (*pte & PTE_D) == 0))){
+    *pte |= PTE_A | ((*pte & PTE_W) ? PTE_D : 0);
+  } else {
+    return -1;
+  }
+  if(p && pagetable == p->pagetable)
+    uvmflush(p, va, 1);
+  return 0;
+}
+
+// Return the physical address of the user page at va in
+// pagetable, faulting it in first if need be, with the current
+// process pinned: swap.c takes none of its pages until
+// uvmunpin(), so the address stays good even if the process
+// is preempted or sleeps in between.
+// Returns 0, unpinned, if va is not user memory.
+uint64
+uvmpin(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+
+  for(;;){
+    if(p)
+      p->pinned++;
+    if((pa = walkaddr(pagetable, va)) != 0)
+      return pa;
+    uvmunpin();
+    // perhaps swapped out.
+    if(uvmfault(pagetable, va) < 0)
+      return 0;
+  }
+}
+
+void
+uvmunpin(void)
+{
+  struct proc *p = myproc();
+
+  if(p)
+    p->pinned--;
+}
+
+// Count the resident and the swapped-out pages
+// among the sz bytes of user memory in pagetable.
+void
+uvmcount(pagetable_t pagetable, uint64 sz, int *resident, int *swapped)
+{
+  pte_t *pte;
+  uint64 va;
+  struct ptecursor c;
+
+  cursorinit(&c, pagetable);
+  *resident = *swapped = 0;
+  for(va = 0; va < sz; va += PGSIZE){
+    if((pte = cursorwalk(&c, va, 0)) == 0)
+      continue;
+    if(*pte & PTE_S)
+      (*swapped)++;
+    else if(*pte & PTE_V)
+      (*resident)++;
+  }
+}
+
+// Find room for a mapping of len bytes between MMAPBASE
+// and USERTOP in p, and a free slot in p->mm->vmas to describe it.
+// Returns the slot, with addr and len set, or 0.
+struct vma *
+vmaalloc(struct proc *p, uint64 len)
+{
+  struct vma *v, *slot = 0;
+  uint64 addr;
+
+  for(v = p->mm->vmas; v < &p->mm->vmas[NVMA]; v++){
+    if(v->addr == 0){
+      slot = v;
+      break;
+    }
+  }
+  len = PGROUNDUP(len);
+  if(slot == 0 || len == 0)
+    return 0;
+
+  // first fit: try MMAPBASE, then the end of each
+  // mapping that overlaps the last try.
+  addr = MMAPBASE;
+again:
+  if(addr + len > USERTOP || addr + len < addr)
+    return 0;
+  for(v = p->mm->vmas; v < &p->mm->vmas[NVMA]; v++){
+    if(v->addr && addr < v->addr + v->len && v->addr < addr + len){
+      addr = v->addr + v->len;
+      goto again;
+    }
+  }
+  slot->addr = addr;
+  slot->len = len;
+  return slot;
+}
+
+// Return p's mapping that contains va, or 0.
+struct vma *
+vmalookup(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->mm->vmas; v < &p->mm->vmas[NVMA]; v++)
+    if(v->addr && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -345,6 +793,40 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// in usercopy.S.
+int usercopy(void *, void *, uint64);
+int usercopystr(char *, char *, uint64);
+
+// Is [va, va+len) user memory of the current process,
+// and pagetable its page table, so that the range can
+// be reached through its kernel page table?
+// The stack guard page is excluded: it lacks PTE_U, which
+// only keeps user mode out, not the kernel.
+static int
+uservisible(pagetable_t pagetable, uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || pagetable != p->pagetable)
+    return 0;
+  if(va + len < va || va + len > p->mm->sz)
+    return 0;
+  return p->mm->guard == 0 || va + len <= p->mm->guard || va >= p->mm->guard + PGSIZE;
+}
+
+// Copy with usercopy() and sstatus.SUM set. Returns -1 if
+// a page faulted; the caller then retries page by page.
+static int
+copyfast(void *dst, void *src, uint64 len)
+{
+  int r;
+
+  w_sstatus(r_sstatus() | SSTATUS_SUM);
+  r = usercopy(dst, src, len);
+  w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+  return r;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -353,15 +835,18 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
 
+  if(uservisible(pagetable, dstva, len) && copyfast((void*)dstva, src, len) == 0)
+    return 0;
+
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if((pa0 = uvmpin(pagetable, va0)) == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
     memmove((void *)(pa0 + (dstva - va0)), src, n);
+    uvmunpin();
 
     len -= n;
     src += n;
@@ -378,15 +863,18 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
 
+  if(uservisible(pagetable, srcva, len) && copyfast(dst, (void*)srcva, len) == 0)
+    return 0;
+
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if((pa0 = uvmpin(pagetable, va0)) == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
     if(n > len)
       n = len;
     memmove(dst, (void *)(pa0 + (srcva - va0)), n);
+    uvmunpin();
 
     len -= n;
     dst += n;
@@ -404,11 +892,26 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
   uint64 n, va0, pa0;
   int got_null = 0;
+  struct proc *p = myproc();
+
+  if(uservisible(pagetable, srcva, 1)){
+    // stop at the end of user memory, or at the guard page.
+    n = p->mm->sz - srcva < max ? p->mm->sz - srcva : max;
+    if(srcva < p->mm->guard && p->mm->guard - srcva < n)
+      n = p->mm->guard - srcva;
+    w_sstatus(r_sstatus() | SSTATUS_SUM);
+    got_null = usercopystr(dst, (char*)srcva, n) == 0;
+    w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+    if(got_null)
+      return 0;
+    // no '\0' before the end of user memory,
+    // or a fault; retry the slow way.
+    got_null = 0;
+  }
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if((pa0 = uvmpin(pagetable, va0)) == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
     if(n > max)
@@ -428,6 +931,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
       p++;
       dst++;
     }
+    uvmunpin();
 
     srcva = va0 + PGSIZE;
   }
@@ -0,0 +1,49 @@
+// Print the disk block cache's hit and miss counts, since boot,
+// or if a command is given, while it ran, and how the buffers
+// are divided between A1in, blocks read in once, and Am, blocks
+// used again over a longer stretch. Reads started ahead of
+// sequential readers are among the misses.
+//
+// usage: bstat [command [args...]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/bstat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct bstat before, after;
+  uint64 n;
+
+  memset(&before, 0, sizeof(before));
+  if(argc > 1){
+    if(bstat(&before) < 0){
+      fprintf(2, "bstat: bstat failed\n");
+      exit(1);
+    }
+    if(spawn(argv[1], argv + 1, 0) < 0){
+      fprintf(2, "bstat: cannot run %s\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+  if(bstat(&after) < 0){
+    fprintf(2, "bstat: bstat failed\n");
+    exit(1);
+  }
+  after.hits -= before.hits;
+  after.misses -= before.misses;
+  after.ghosthits -= before.ghosthits;
+  after.readahead -= before.readahead;
+
+  n = after.hits + after.misses;
+  printf("lookups %l: hits %l (%l%%), misses %l, of which from A1out %l\n",
+         n, after.hits, n ? after.hits * 100 / n : 0,
+         after.misses, after.ghosthits);
+  printf("read ahead %l\n", after.readahead);
+  printf("buffers %d of at most %d: A1in %d, Am %d\n",
+         after.nbuf, after.maxbuf, after.ncold, after.nhot);
+  exit(0);
+}
@@ -0,0 +1,75 @@
+// Run a command with the kernel's tracepoints in mask enabled,
+// and write the events recorded meanwhile to file, as struct
+// events (kernel/event.h), for analysis elsewhere. Without a
+// command, write out whatever events the kernel still holds.
+//
+// usage: evdump mask file [command [args...]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleeplock.h"
+#include "kernel/fs.h"
+#include "kernel/file.h"
+#include "kernel/event.h"
+#include "user/user.h"
+
+#define NEV 64   // events per read()
+
+static struct event evs[NEV];
+
+int
+main(int argc, char *argv[])
+{
+  int dev, fd, i, n, mask, nev = 0, lost = 0;
+
+  if(argc < 3){
+    fprintf(2, "usage: evdump mask file [command [args...]]\n");
+    exit(1);
+  }
+  mask = atoi(argv[1]);
+
+  if((dev = open("events", O_RDONLY)) < 0){
+    mknod("events", EVENTS, 0);
+    dev = open("events", O_RDONLY);
+  }
+  if(dev < 0){
+    fprintf(2, "evdump: cannot open the event device\n");
+    exit(1);
+  }
+
+  if(argc > 3){
+    // drop the events from before.
+    while(read(dev, evs, sizeof(evs)) > 0)
+      ;
+    evtrace(mask);
+    if(spawn(argv[3], argv + 3, 0) < 0){
+      evtrace(0);
+      fprintf(2, "evdump: cannot run %s\n", argv[3]);
+      exit(1);
+    }
+    wait(0);
+    evtrace(0);
+  }
+
+  if((fd = open(argv[2], O_CREATE|O_WRONLY|O_TRUNC)) < 0){
+    fprintf(2, "evdump: cannot create %s\n", argv[2]);
+    exit(1);
+  }
+  while((n = read(dev, evs, sizeof(evs))) > 0){
+    if(write(fd, evs, n) != n){
+      fprintf(2, "evdump: write %s failed\n", argv[2]);
+      exit(1);
+    }
+    for(i = 0; i < n / sizeof(evs[0]); i++){
+      if(evs[i].type == EV_LOST)
+        lost += evs[i].a;
+      else
+        nev++;
+    }
+  }
+  close(fd);
+  printf("evdump: %d events to %s, %d lost\n", nev, argv[2], lost);
+  exit(0);
+}
@@ -1,11 +1,12 @@
 // Test that fork fails gracefully.
-// Tiny executable so that the limit can be filling the proc table.
+// Tiny executable so that as many children as possible fit in memory.
 
+#include "kernel/param.h"
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
 
-#define N  1000
+#define N  NPROC
 
 void
 print(const char *s)
@@ -0,0 +1,80 @@
+// Time numeric work in hardware floating point against the
+// same work in software fixed point, then with several FP
+// processes sharing the harts, whose registers the kernel
+// switches lazily. Each prints pi, from the Leibniz series,
+// times 10^6.
+//
+// usage: fpbench [terms] [processes]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define FRAC 32   // fixed-point fraction bits
+
+static double
+fppi(int n)
+{
+  double s = 0, d = 1;
+  int i;
+
+  for(i = 0; i < n; i++, d += 2)
+    s += (i & 1) ? -1 / d : 1 / d;
+  return 4 * s;
+}
+
+static long
+fixpi(int n)
+{
+  long s = 0, d = 1;
+  int i;
+
+  for(i = 0; i < n; i++, d += 2)
+    s += (i & 1) ? -((1L << FRAC) / d) : (1L << FRAC) / d;
+  return 4 * s;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n = 2000000, nproc = 4, start, xstatus, ok;
+  double pi;
+  long fix;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2)
+    nproc = atoi(argv[2]);
+
+  start = uptime();
+  pi = fppi(n);
+  printf("float %d terms: pi*10^6 = %d, %d ticks\n", n,
+         (int)(pi * 1000000), uptime() - start);
+
+  start = uptime();
+  fix = fixpi(n);
+  printf("fixed %d terms: pi*10^6 = %d, %d ticks\n", n,
+         (int)((fix * 1000000) >> FRAC), uptime() - start);
+
+  // each child checks that its result, computed while the
+  // others use the FP registers too, is the same.
+  start = uptime();
+  for(i = 0; i < nproc; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("fpbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      exit(fppi(n) == pi ? 0 : 1);
+  }
+  ok = 1;
+  for(i = 0; i < nproc; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      ok = 0;
+  }
+  printf("float %d terms in %d processes: %d ticks%s\n", n, nproc,
+         uptime() - start, ok ? "" : ", WRONG RESULT");
+  exit(ok ? 0 : 1);
+}
@@ -0,0 +1,101 @@
+// Time lock handoffs between threads made by clone():
+// a ulib mutex, which sleeps in futex_wait() when it is
+// contended, against a lock that spins, and the cost of
+// a mutex that no other thread wants.
+//
+// usage: futexbench [threads] [iterations]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXTHREADS 8
+
+struct mutex mu;
+int spin;
+int nthreads, iters;
+volatile int count;
+
+void
+mutexthread(void *arg)
+{
+  int i;
+
+  for(i = 0; i < iters; i++){
+    mutex_lock(&mu);
+    count++;
+    mutex_unlock(&mu);
+  }
+  exit(0);
+}
+
+void
+spinthread(void *arg)
+{
+  int i;
+
+  for(i = 0; i < iters; i++){
+    while(__atomic_exchange_n(&spin, 1, __ATOMIC_ACQUIRE) != 0)
+      ;
+    count++;
+    __atomic_store_n(&spin, 0, __ATOMIC_RELEASE);
+  }
+  exit(0);
+}
+
+// run fn in nthreads threads, and return the ticks taken.
+int
+run(void (*fn)(void*))
+{
+  char *stacks[MAXTHREADS];
+  void *stack;
+  int i, start;
+
+  count = 0;
+  start = uptime();
+  for(i = 0; i < nthreads; i++){
+    stacks[i] = malloc(4096);
+    if(clone(fn, 0, (char*)(((uint64)stacks[i] + 4096) & ~15L)) < 0){
+      printf("futexbench: clone failed\n");
+      exit(1);
+    }
+  }
+  for(i = 0; i < nthreads; i++)
+    join(&stack);
+  start = uptime() - start;
+  for(i = 0; i < nthreads; i++)
+    free(stacks[i]);
+  if(count != nthreads*iters){
+    printf("futexbench: count %d, not %d\n", count, nthreads*iters);
+    exit(1);
+  }
+  return start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, start;
+
+  nthreads = 4;
+  iters = 100000;
+  if(argc > 1)
+    nthreads = atoi(argv[1]);
+  if(argc > 2)
+    iters = atoi(argv[2]);
+  if(nthreads < 1 || nthreads > MAXTHREADS){
+    printf("futexbench: 1 to %d threads\n", MAXTHREADS);
+    exit(1);
+  }
+
+  mutex_init(&mu);
+  start = uptime();
+  for(i = 0; i < nthreads*iters; i++){
+    mutex_lock(&mu);
+    mutex_unlock(&mu);
+  }
+  printf("uncontended %d: %d ticks\n", nthreads*iters, uptime() - start);
+  printf("mutex %d threads: %d ticks\n", nthreads, run(mutexthread));
+  printf("spin  %d threads: %d ticks\n", nthreads, run(spinthread));
+  exit(0);
+}
@@ -0,0 +1,75 @@
+// Measure spinlock throughput and fairness: processes on all
+// harts take and release one kernel lock (lockbench()) for the
+// same stretch of time. Prints how often each got it, the total
+// per millisecond, and how the fewest compares to the most.
+// Build the kernel with TICKETLOCK=1 to compare ticket locks.
+//
+// usage: lockbench [processes] [ms]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, nproc = 3, ms = 1000, go[2], res[2];
+  int min, max, total;
+
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(argc > 2)
+    ms = atoi(argv[2]);
+  if(nproc < 1 || ms < 1 || ms > 10000){
+    fprintf(2, "usage: lockbench [processes] [ms]\n");
+    exit(1);
+  }
+  if(pipe(go) < 0 || pipe(res) < 0){
+    fprintf(2, "lockbench: pipe failed\n");
+    exit(1);
+  }
+
+  for(i = 0; i < nproc; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "lockbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      char c;
+      close(go[1]);
+      // start together, once all are forked.
+      if(read(go[0], &c, 1) != 1)
+        exit(1);
+      n = lockbench(ms);
+      write(res[1], &n, sizeof(n));
+      exit(n < 0);
+    }
+  }
+  close(go[0]);
+  close(res[1]);
+  for(i = 0; i < nproc; i++)
+    write(go[1], "x", 1);
+
+  min = max = -1;
+  total = 0;
+  for(i = 0; i < nproc; i++){
+    if(read(res[0], &n, sizeof(n)) != sizeof(n) || n < 0){
+      fprintf(2, "lockbench: lockbench failed\n");
+      exit(1);
+    }
+    printf("process %d: %d acquires\n", i, n);
+    total += n;
+    if(min < 0 || n < min)
+      min = n;
+    if(n > max)
+      max = n;
+  }
+  for(i = 0; i < nproc; i++)
+    wait(0);
+
+  printf("%d processes, %d ms: %d acquires, %d per ms\n",
+         nproc, ms, total, total / ms);
+  printf("fairness (fewest/most): %d%%\n", max > 0 ? min * 100 / max : 0);
+  exit(0);
+}
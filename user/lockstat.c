@@ -0,0 +1,88 @@
+// Print the kernel's lock contention counts, most contended
+// first, for all locks of each name: since boot, or if a
+// command is given, while it ran. For sleeplocks, spun is how
+// many waits spun on a running holder, and won how many of
+// those got the lock without sleeping, to tune SLEEPSPIN by.
+// Needs a kernel built with make LOCKSTAT=1.
+//
+// usage: lockstat [command [args...]]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/vdso.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+#define NSTAT 128
+
+static struct lockstat before[NSTAT], after[NSTAT];
+
+static void
+pad(char *s, int w)
+{
+  int n;
+
+  printf("%s", s);
+  for(n = strlen(s); n < w; n++)
+    printf(" ");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat t;
+  int i, j, n;
+
+  if(lockstat(before, NSTAT) < 0){
+    fprintf(2, "lockstat: kernel not built with LOCKSTAT=1\n");
+    exit(1);
+  }
+  if(argc > 1){
+    if(spawn(argv[1], argv + 1, 0) < 0){
+      fprintf(2, "lockstat: cannot run %s\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  } else {
+    memset(before, 0, sizeof(before));
+  }
+  if((n = lockstat(after, NSTAT)) < 0){
+    fprintf(2, "lockstat: lockstat failed\n");
+    exit(1);
+  }
+  if(n > NSTAT)
+    n = NSTAT;
+
+  // entries keep their places, and new ones go at the end.
+  for(i = 0; i < n; i++){
+    if(before[i].name[0] == 0)
+      continue;
+    after[i].acquires -= before[i].acquires;
+    after[i].contended -= before[i].contended;
+    after[i].spins -= before[i].spins;
+    after[i].spinwaits -= before[i].spinwaits;
+    after[i].spinwins -= before[i].spinwins;
+    after[i].holdtotal -= before[i].holdtotal;
+  }
+  // most contended first, then most acquired.
+  for(i = 1; i < n; i++){
+    t = after[i];
+    for(j = i; j > 0 && (after[j-1].contended < t.contended ||
+        (after[j-1].contended == t.contended && after[j-1].acquires < t.acquires)); j--)
+      after[j] = after[j-1];
+    after[j] = t;
+  }
+
+  printf("lock            kind  locks acquires contended spins avg-hold-ns max-hold-us spun won\n");
+  for(i = 0; i < n && after[i].acquires > 0; i++){
+    pad(after[i].name, 16);
+    printf("%s %d %l %l %l %l %l", after[i].sleep ? "sleep" : "spin ",
+           after[i].nlock, after[i].acquires, after[i].contended, after[i].spins,
+           after[i].holdtotal / after[i].acquires * (1000000000 / TIMEBASE),
+           after[i].holdmax * 1000000 / TIMEBASE);
+    if(after[i].sleep)
+      printf(" %l %l", after[i].spinwaits, after[i].spinwins);
+    printf("\n");
+  }
+  exit(0);
+}
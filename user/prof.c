@@ -0,0 +1,265 @@
+// Run a command with the sampling profiler on, and print where
+// the timer interrupts found each CPU meanwhile, most samples
+// first, as "process;function count" lines, the folded form
+// that flame graph tools read. Kernel functions are marked [k],
+// and named from kernel.sym; a program's from name.sym, if the
+// file system has it (see SYMS in the Makefile), or else
+// shown as addresses. "idle" is a CPU with no process.
+//
+// usage: prof command [args...]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/memlayout.h"
+#include "kernel/riscv.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleeplock.h"
+#include "kernel/fs.h"
+#include "kernel/file.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+#define NSYMTAB 8      // most symbol tables to load
+#define NOUT    512    // most lines of output
+#define KEYLEN  48
+#define FILELEN 32
+
+struct sym {
+  uint64 addr;
+  char *name;
+};
+
+struct symtab {
+  char file[FILELEN];
+  int n;               // 0 if the file was missing
+  struct sym *syms;    // sorted by addr
+};
+
+struct out {
+  char key[KEYLEN];
+  uint count;
+};
+
+static struct symtab symtabs[NSYMTAB];
+static int nsymtab;
+static struct out outs[NOUT];
+static int nout;
+static struct profent ents[64];
+
+static uint64
+hexval(char *s, char **end)
+{
+  uint64 v = 0;
+  int d;
+
+  for(;; s++){
+    if(*s >= '0' && *s <= '9')
+      d = *s - '0';
+    else if(*s >= 'a' && *s <= 'f')
+      d = *s - 'a' + 10;
+    else
+      break;
+    v = v * 16 + d;
+  }
+  *end = s;
+  return v;
+}
+
+// Load file, a list of "address name" lines, as written by
+// objdump -t and the Makefile's sed, keeping the functions and
+// other symbols, but not the names of files and sections.
+static void
+loadsyms(struct symtab *t, char *file)
+{
+  struct stat st;
+  struct sym s;
+  char *buf, *p, *e;
+  int fd, i, n;
+
+  strcpy(t->file, file);
+  t->n = 0;
+  if((fd = open(file, O_RDONLY)) < 0)
+    return;
+  if(fstat(fd, &st) < 0 || (buf = malloc(st.size + 1)) == 0){
+    close(fd);
+    return;
+  }
+  n = read(fd, buf, st.size);
+  close(fd);
+  if(n < 0)
+    n = 0;
+  buf[n] = 0;
+
+  for(n = 0, p = buf; *p; p++)
+    if(*p == '\n')
+      n++;
+  if((t->syms = malloc((n + 1) * sizeof(struct sym))) == 0)
+    return;
+  for(p = buf; *p; p = e){
+    s.addr = hexval(p, &e);
+    if(*e == ' ')
+      e++;
+    s.name = e;
+    while(*e && *e != '\n')
+      e++;
+    if(*e)
+      *e++ = 0;
+    if(strchr(s.name, '.') || s.name[0] == 0)
+      continue;
+    // insert in order.
+    for(i = t->n; i > 0 && t->syms[i-1].addr > s.addr; i--)
+      t->syms[i] = t->syms[i-1];
+    t->syms[i] = s;
+    t->n++;
+  }
+}
+
+static struct symtab*
+symtab(char *file)
+{
+  int i;
+
+  for(i = 0; i < nsymtab; i++)
+    if(strcmp(symtabs[i].file, file) == 0)
+      return &symtabs[i];
+  if(nsymtab == NSYMTAB)
+    return 0;
+  loadsyms(&symtabs[nsymtab], file);
+  return &symtabs[nsymtab++];
+}
+
+// The name of the symbol that pc is in, or 0.
+static char*
+symname(struct symtab *t, uint64 pc)
+{
+  int lo = 0, hi, mid;
+
+  if(t == 0 || t->n == 0 || pc < t->syms[0].addr)
+    return 0;
+  hi = t->n - 1;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(t->syms[mid].addr <= pc)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return t->syms[lo].name;
+}
+
+static void
+append(char *key, char *s, int max)
+{
+  int n = strlen(key);
+
+  while(*s && n < max - 1)
+    key[n++] = *s++;
+  key[n] = 0;
+}
+
+static void
+hex(char *buf, uint64 v)
+{
+  static char digits[] = "0123456789abcdef";
+  char tmp[17];
+  int i = 0;
+
+  do {
+    tmp[i++] = digits[v % 16];
+    v /= 16;
+  } while(v);
+  *buf++ = '0';
+  *buf++ = 'x';
+  while(i > 0)
+    *buf++ = tmp[--i];
+  *buf = 0;
+}
+
+static void
+addsample(struct profent *e)
+{
+  char key[KEYLEN], file[FILELEN], addr[20], *fn;
+  int i;
+
+  key[0] = 0;
+  if(e->pc == 0){
+    append(key, "dropped", KEYLEN);
+  } else {
+    append(key, e->pid ? e->name : "idle", KEYLEN);
+    append(key, ";", KEYLEN);
+    if(e->pc >= KERNBASE){
+      append(key, "[k]", KEYLEN);
+      fn = symname(symtab("kernel.sym"), e->pc);
+    } else {
+      // open() looks at only DIRSIZ bytes of the
+      // name, as mkfs kept of the file's.
+      file[0] = 0;
+      append(file, e->name, FILELEN);
+      append(file, ".sym", FILELEN);
+      fn = symname(symtab(file), e->pc);
+    }
+    if(fn == 0){
+      hex(addr, e->pc);
+      fn = addr;
+    }
+    append(key, fn, KEYLEN);
+  }
+
+  for(i = 0; i < nout; i++){
+    if(strcmp(outs[i].key, key) == 0){
+      outs[i].count += e->count;
+      return;
+    }
+  }
+  if(nout < NOUT){
+    strcpy(outs[nout].key, key);
+    outs[nout++].count = e->count;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct out o;
+  int fd, i, j, n;
+
+  if(argc < 2){
+    fprintf(2, "usage: prof command [args...]\n");
+    exit(1);
+  }
+  if((fd = open("profile", O_RDONLY)) < 0){
+    mknod("profile", PROFILE, 0);
+    fd = open("profile", O_RDONLY);
+  }
+  if(fd < 0){
+    fprintf(2, "prof: cannot open the profile device\n");
+    exit(1);
+  }
+
+  profile(1);
+  if(spawn(argv[1], argv + 1, 0) < 0){
+    profile(0);
+    fprintf(2, "prof: cannot run %s\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  profile(0);
+
+  while((n = read(fd, ents, sizeof(ents))) > 0)
+    for(i = 0; i < n / sizeof(ents[0]); i++)
+      addsample(&ents[i]);
+  close(fd);
+
+  // most samples first.
+  for(i = 1; i < nout; i++){
+    o = outs[i];
+    for(j = i; j > 0 && outs[j-1].count < o.count; j--)
+      outs[j] = outs[j-1];
+    outs[j] = o;
+  }
+  for(i = 0; i < nout; i++)
+    printf("%s %d\n", outs[i].key, outs[i].count);
+  exit(0);
+}
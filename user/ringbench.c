@@ -0,0 +1,85 @@
+// Time writing a file a block at a time with write() against
+// the same writes queued on a syscall ring, in batches, so that
+// the process traps once per batch rather than once per block.
+// Both print the ticks taken.
+//
+// usage: ringbench [blocks] [batch] [workers]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/ring.h"
+#include "user/user.h"
+
+#define BSIZE 512
+
+static char buf[BSIZE];
+
+int
+main(int argc, char *argv[])
+{
+  int i, n = 400, batch = 16, nworker = 2, fd, start, queued, done, ok;
+  struct ringpage *r;
+  uint64 d;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2)
+    batch = atoi(argv[2]);
+  if(argc > 3)
+    nworker = atoi(argv[3]);
+  if(batch < 1 || batch > NRINGENT){
+    printf("ringbench: batch must be 1 to %d\n", NRINGENT);
+    exit(1);
+  }
+  memset(buf, 'r', sizeof(buf));
+
+  if((fd = open("ringbench.tmp", O_CREATE|O_RDWR)) < 0){
+    printf("ringbench: open failed\n");
+    exit(1);
+  }
+  start = uptime();
+  for(i = 0; i < n; i++){
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("ringbench: write failed\n");
+      exit(1);
+    }
+  }
+  printf("write(): %d blocks, %d ticks\n", n, uptime() - start);
+  close(fd);
+  unlink("ringbench.tmp");
+
+  if((r = ring_setup(nworker)) == (struct ringpage*)-1){
+    printf("ringbench: ring_setup failed\n");
+    exit(1);
+  }
+  if((fd = open("ringbench.tmp", O_CREATE|O_RDWR)) < 0){
+    printf("ringbench: open failed\n");
+    exit(1);
+  }
+  // the writes share the file offset, and each is one
+  // block, so their order does not matter here.
+  start = uptime();
+  ok = 1;
+  for(queued = done = 0; done < n; ){
+    i = 0;
+    while(queued < n && queued - done < batch){
+      ring_submit(r, RING_WRITE, fd, buf, BSIZE, queued++);
+      i = 1;
+    }
+    if(ring_enter(i, 1) < 1){
+      printf("ringbench: ring_enter failed\n");
+      exit(1);
+    }
+    while(r->cqtail != r->cqhead){
+      if(ring_reap(r, &d) != BSIZE)
+        ok = 0;
+      done++;
+    }
+  }
+  printf("ring, batches of %d, %d workers: %d blocks, %d ticks%s\n",
+         batch, nworker, n, uptime() - start, ok ? "" : ", WRITE FAILED");
+  close(fd);
+  unlink("ringbench.tmp");
+  exit(ok ? 0 : 1);
+}
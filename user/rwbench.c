@@ -0,0 +1,114 @@
+// Time copies between user and kernel memory:
+// large pipe transfers, re-reads of a file that stays
+// in the buffer cache, and many small fstat() calls.
+//
+// usage: rwbench [megabytes]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+#define BUFSZ 8192
+#define FILESZ (16*1024)  // small enough to stay in the buffer cache
+
+char buf[BUFSZ];
+
+// push mb megabytes through a pipe in BUFSZ writes.
+int
+pipebench(int mb)
+{
+  int fds[2], pid, n, total, start;
+
+  if(pipe(fds) < 0){
+    printf("rwbench: pipe failed\n");
+    exit(1);
+  }
+  start = uptime();
+  pid = fork();
+  if(pid < 0){
+    printf("rwbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(total = 0; total < mb*1024*1024; total += BUFSZ){
+      if(write(fds[1], buf, BUFSZ) != BUFSZ){
+        printf("rwbench: pipe write failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  total = 0;
+  while((n = read(fds[0], buf, BUFSZ)) > 0)
+    total += n;
+  close(fds[0]);
+  wait(0);
+  if(total != mb*1024*1024){
+    printf("rwbench: pipe read %d bytes\n", total);
+    exit(1);
+  }
+  return uptime() - start;
+}
+
+// read a cached file mb megabytes' worth, BUFSZ at a time.
+int
+filebench(int mb)
+{
+  int fd, i, total, start;
+
+  fd = open("rwbench.tmp", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("rwbench: create failed\n");
+    exit(1);
+  }
+  for(i = 0; i < FILESZ; i += BUFSZ)
+    write(fd, buf, BUFSZ);
+  close(fd);
+
+  start = uptime();
+  for(total = 0; total < mb*1024*1024; ){
+    fd = open("rwbench.tmp", O_RDONLY);
+    for(i = 0; i < FILESZ; i += BUFSZ){
+      if(read(fd, buf, BUFSZ) != BUFSZ){
+        printf("rwbench: read failed\n");
+        exit(1);
+      }
+      total += BUFSZ;
+    }
+    close(fd);
+  }
+  i = uptime() - start;
+  unlink("rwbench.tmp");
+  return i;
+}
+
+// n fstat() calls, each copying out a struct stat.
+int
+statbench(int n)
+{
+  struct stat st;
+  int i, start;
+
+  start = uptime();
+  for(i = 0; i < n; i++)
+    fstat(1, &st);
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb = 16;
+
+  if(argc > 1)
+    mb = atoi(argv[1]);
+  memset(buf, 'x', sizeof(buf));
+
+  printf("pipe  %d MB: %d ticks\n", mb, pipebench(mb));
+  printf("read  %d MB: %d ticks\n", mb, filebench(mb));
+  printf("fstat %d calls: %d ticks\n", 100000, statbench(100000));
+  exit(0);
+}
@@ -1,6 +1,7 @@
 // Shell.
 
 #include "kernel/types.h"
+#include "kernel/param.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
 
@@ -54,6 +55,53 @@ void panic(char*);
 struct cmd *parsecmd(char*);
 void runcmd(struct cmd*) __attribute__((noreturn));
 
+// Start cmd with spawn(), if it is a plain command with
+// redirections, after the nacts file actions in acts.
+// This saves forking a copy of the shell only to exec().
+// Returns the child's pid, -1 if it could not be started,
+// or 0 if cmd needs a forked shell to run it: if it is not
+// a plain command, or has more redirections than spawn()
+// takes file actions for.
+int
+spawncmd(struct cmd *cmd, struct spawnaction *acts, int nacts)
+{
+  struct spawnaction a[MAXSPAWNACT];
+  struct execcmd *ecmd;
+  struct redircmd *rcmd;
+  int fds[MAXARGS], nfds = 0, n, fd, pid = -1;
+
+  memmove(a, acts, nacts*sizeof(a[0]));
+  n = nacts;
+  for(; cmd->type == REDIR; cmd = rcmd->cmd){
+    rcmd = (struct redircmd*)cmd;
+    // two actions, and the terminating one.
+    if(nfds == MAXARGS || n + 3 > MAXSPAWNACT){
+      pid = 0;
+      goto out;
+    }
+    if((fd = open(rcmd->file, rcmd->mode)) < 0){
+      fprintf(2, "open %s failed\n", rcmd->file);
+      goto out;
+    }
+    fds[nfds++] = fd;
+    a[n++] = (struct spawnaction){ SPAWN_DUP2, fd, rcmd->fd };
+    if(fd != rcmd->fd)
+      a[n++] = (struct spawnaction){ SPAWN_CLOSE, fd, 0 };
+  }
+  ecmd = (struct execcmd*)cmd;
+  if(cmd->type != EXEC || ecmd->argv[0] == 0){
+    pid = 0;
+    goto out;
+  }
+  a[n].op = 0;
+  if((pid = spawn(ecmd->argv[0], ecmd->argv, a)) < 0)
+    fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+out:
+  while(nfds > 0)
+    close(fds[--nfds]);
+  return pid;
+}
+
 // Execute cmd.  Never returns.
 void
 runcmd(struct cmd *cmd)
@@ -102,14 +150,18 @@ runcmd(struct cmd *cmd)
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
-    if(fork1() == 0){
+    struct spawnaction a[3] = {
+      { SPAWN_DUP2, p[1], 1 }, { SPAWN_CLOSE, p[0], 0 }, { SPAWN_CLOSE, p[1], 0 },
+    };
+    if(spawncmd(pcmd->left, a, 3) == 0 && fork1() == 0){
       close(1);
       dup(p[1]);
       close(p[0]);
       close(p[1]);
       runcmd(pcmd->left);
     }
-    if(fork1() == 0){
+    a[0] = (struct spawnaction){ SPAWN_DUP2, p[0], 0 };
+    if(spawncmd(pcmd->right, a, 3) == 0 && fork1() == 0){
       close(0);
       dup(p[0]);
       close(p[0]);
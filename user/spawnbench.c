@@ -0,0 +1,60 @@
+// Time starting programs with fork() and exec() against
+// spawn(), from a parent that has grown its memory to make
+// fork()'s copy of it, which exec() throws away, show.
+//
+// usage: spawnbench [count] [parent-megabytes]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  char *childargv[] = { "spawnbench", "-child", 0 };
+  int i, n = 200, mb = 4, start, pid;
+  char *p;
+
+  // the child that each run starts: do nothing.
+  if(argc > 1 && strcmp(argv[1], "-child") == 0)
+    exit(0);
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2)
+    mb = atoi(argv[2]);
+
+  // touch each page, so fork() has to copy it.
+  if((p = sbrk(mb*1024*1024)) == (char*)-1){
+    printf("spawnbench: sbrk failed\n");
+    exit(1);
+  }
+  for(i = 0; i < mb*1024*1024; i += 4096)
+    p[i] = 1;
+
+  start = uptime();
+  for(i = 0; i < n; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("spawnbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(childargv[0], childargv);
+      printf("spawnbench: exec failed\n");
+      exit(1);
+    }
+    wait(0);
+  }
+  printf("fork+exec %d times, %d MB parent: %d ticks\n", n, mb, uptime() - start);
+
+  start = uptime();
+  for(i = 0; i < n; i++){
+    if(spawn(childargv[0], childargv, 0) < 0){
+      printf("spawnbench: spawn failed\n");
+      exit(1);
+    }
+    wait(0);
+  }
+  printf("spawn     %d times, %d MB parent: %d ticks\n", n, mb, uptime() - start);
+  exit(0);
+}
@@ -1,20 +1,142 @@
+// Run a command, tracing the system calls in mask, and print
+// each as it returns, from the records the kernel leaves on
+// the trace device, with its arguments decoded by type.
+//
+// usage: strace mask command [args...]
+
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleeplock.h"
+#include "kernel/fs.h"
+#include "kernel/file.h"
+#include "kernel/riscv.h"
+#include "kernel/syscall.h"
+#include "kernel/sysstat.h"
+#include "kernel/trace.h"
+#include "kernel/vdso.h"
 #include "user/user.h"
 
-int main(int argc, char *argv[])
+#define NSTAT 64   // most system call numbers to name
+#define NREC  32   // records per read()
+
+static struct sysstat names[NSTAT];
+static struct tracerec recs[NREC];
+
+static void
+printrec(struct tracerec *r)
 {
-	if (argc < 3)
-	{
-		fprintf(2, "strace: insufficient arguments passed\n");
-		exit(1);
-	}
+  int i, nstr = 0;
+
+  if(r->num >= 0 && r->num < NSTAT && names[r->num].name[0])
+    printf("%d: syscall %s(", r->pid, names[r->num].name);
+  else
+    printf("%d: syscall %d(", r->pid, r->num);
+  for(i = 0; i < NTRACEARG && r->types[i]; i++){
+    if(i > 0)
+      printf(", ");
+    if(r->types[i] == 's' && nstr < 2)
+      printf("\"%s\"", r->str[nstr++]);
+    else if(r->types[i] == 'i')
+      printf("%d", (int)r->args[i]);
+    else
+      printf("%p", r->args[i]);
+  }
+  printf(") -> %d", (int)r->ret);
+  if(r->num != SYS_exit)
+    printf(" [%l us]", (r->end - r->start) * 1000000 / TIMEBASE);
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, n, pid, ticker, mask, done, sync[2];
+  uint lost = 0;
+  uint64 start;
+
+  if(argc < 3){
+    fprintf(2, "usage: strace mask command [args...]\n");
+    exit(1);
+  }
+  mask = atoi(argv[1]);
 
-	char *command = argv[2];
-	int mask = atoi(argv[1]);
+  if((fd = open("trace", O_RDONLY)) < 0){
+    mknod("trace", TRACE, 0);
+    fd = open("trace", O_RDONLY);
+  }
+  if(fd < 0 || sysstat(names, NSTAT) < 0 || pipe(sync) < 0){
+    fprintf(2, "strace: cannot read the trace device\n");
+    exit(1);
+  }
 
-	strace(mask);
-	exec(command, &argv[2]);
+  // earlier records may still be in the kernel's rings.
+  start = r_time();
+  // the command's exit() record may be overwritten before it is
+  // read, so a ticker runs the command, waits for it, and then
+  // leaves a getpid() record of its own each tick, which also
+  // tells us the command is done.
+  ticker = fork();
+  if(ticker == 0){
+    close(fd);
+    close(sync[0]);
+    pid = fork();
+    if(pid == 0){
+      close(sync[1]);
+      // trace exit() too, to know when to stop.
+      strace(mask | (1 << SYS_exit));
+      exec(argv[2], &argv[2]);
+      fprintf(2, "strace: exec %s failed\n", argv[2]);
+      exit(1);
+    }
+    write(sync[1], &pid, sizeof(pid));
+    close(sync[1]);
+    if(pid < 0)
+      exit(1);
+    wait(0);
+    strace(1 << SYS_getpid);
+    for(;;){
+      sysgetpid();
+      sleep(1);
+    }
+  }
+  close(sync[1]);
+  if(ticker < 0 || read(sync[0], &pid, sizeof(pid)) != sizeof(pid) || pid < 0){
+    fprintf(2, "strace: fork failed\n");
+    exit(1);
+  }
+  close(sync[0]);
 
-	exit(0);
-}
\ No newline at end of file
+  for(done = 0; ; ){
+    if((n = read(fd, recs, sizeof(recs))) <= 0){
+      fprintf(2, "strace: read failed\n");
+      break;
+    }
+    for(i = 0; i < n / sizeof(recs[0]); i++){
+      if(recs[i].start < start)
+        continue;
+      if(recs[i].lost){
+        printf("strace: %d records lost\n", recs[i].lost);
+        lost += recs[i].lost;
+      }
+      if(recs[i].pid == ticker){
+        done = 1;
+        continue;
+      }
+      if(recs[i].num != SYS_exit || (mask & (1 << SYS_exit)))
+        printrec(&recs[i]);
+      if(recs[i].num == SYS_exit && recs[i].pid == pid)
+        done = 1;
+    }
+    // a short read emptied every CPU's ring, so the command's
+    // last records, made before the end was seen, are all in.
+    if(done && n < sizeof(recs))
+      break;
+  }
+  kill(ticker);
+  wait(0);
+  if(lost)
+    printf("strace: %d records lost in all\n", lost);
+  exit(0);
+}
@@ -0,0 +1,106 @@
+// Run a command and print the system calls made while it
+// ran, by every process, most total time first, each with
+// its count, its total and average time, and a histogram
+// of how long the calls took. sysprof's own wait() for the
+// command is among them.
+//
+// usage: sysprof command [args...]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/vdso.h"
+#include "kernel/sysstat.h"
+#include "user/user.h"
+
+#define NSTAT 64   // most system call numbers to read
+
+// time CSR counts to microseconds
+static uint64
+us(uint64 t)
+{
+  return t * 1000000 / TIMEBASE;
+}
+
+static void
+printhist(struct sysstat *st)
+{
+  uint64 ns;
+  int b;
+
+  printf("   ");
+  for(b = 0; b < NSYSHIST; b++){
+    if(st->hist[b] == 0)
+      continue;
+    if(b == NSYSHIST - 1){
+      ns = (1ULL << b) * 1000000000 / TIMEBASE;
+      printf(" >=%lus:%l", ns / 1000, st->hist[b]);
+      continue;
+    }
+    ns = (2ULL << b) * 1000000000 / TIMEBASE;
+    if(ns < 1000)
+      printf(" <%lns:%l", ns, st->hist[b]);
+    else
+      printf(" <%lus:%l", ns / 1000, st->hist[b]);
+  }
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sysstat *before, *after, t;
+  int i, j, n, pid;
+
+  if(argc < 2){
+    fprintf(2, "usage: sysprof command [args...]\n");
+    exit(1);
+  }
+  before = malloc(NSTAT * sizeof(struct sysstat));
+  after = malloc(NSTAT * sizeof(struct sysstat));
+  if(before == 0 || after == 0){
+    fprintf(2, "sysprof: out of memory\n");
+    exit(1);
+  }
+
+  if(sysstat(before, NSTAT) < 0){
+    fprintf(2, "sysprof: sysstat failed\n");
+    exit(1);
+  }
+  if((pid = spawn(argv[1], argv + 1, 0)) < 0){
+    fprintf(2, "sysprof: cannot run %s\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  if((n = sysstat(after, NSTAT)) < 0){
+    fprintf(2, "sysprof: sysstat failed\n");
+    exit(1);
+  }
+  if(n > NSTAT)
+    n = NSTAT;
+
+  for(i = 0; i < n; i++){
+    after[i].count -= before[i].count;
+    after[i].time -= before[i].time;
+    for(j = 0; j < NSYSHIST; j++)
+      after[i].hist[j] -= before[i].hist[j];
+  }
+  // most total time first.
+  for(i = 1; i < n; i++){
+    t = after[i];
+    for(j = i; j > 0 && after[j-1].time < t.time; j--)
+      after[j] = after[j-1];
+    after[j] = t;
+  }
+
+  printf("%s: pid %d\n", argv[1], pid);
+  printf("syscall         calls total-us avg-us\n");
+  for(i = 0; i < n && after[i].count > 0; i++){
+    printf("%s", after[i].name);
+    for(j = strlen(after[i].name); j < 16; j++)
+      printf(" ");
+    printf("%l %l %l\n", after[i].count, us(after[i].time),
+           us(after[i].time) / after[i].count);
+    printhist(&after[i]);
+  }
+  exit(0);
+}
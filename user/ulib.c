@@ -1,6 +1,11 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/ring.h"
+#include "kernel/param.h"
+#include "kernel/memlayout.h"
+#include "kernel/riscv.h"
+#include "kernel/vdso.h"
 #include "user/user.h"
 
 //
@@ -14,6 +19,44 @@ _main()
   exit(0);
 }
 
+// The time and pid, read from the vDSO pages
+// (kernel/vdso.c) rather than by system calls.
+
+int
+uptime(void)
+{
+  return ((volatile struct vdso*)VDSO)->ticks;
+}
+
+// Nanoseconds since boot, from the time CSR.
+uint64
+uptimens(void)
+{
+  volatile struct vdso *v = (volatile struct vdso*)VDSO;
+  uint64 cycles, ns, nsmult, t;
+  uint seq;
+
+  do {
+    while((seq = v->seq) & 1)
+      ;
+    __sync_synchronize();
+    cycles = v->cycles;
+    ns = v->ns;
+    nsmult = v->nsmult;
+    t = r_time();
+    __sync_synchronize();
+  } while(v->seq != seq);
+  return ns + (((t - cycles) * nsmult) >> NSSHIFT);
+}
+
+int
+getpid(void)
+{
+  int pid = ((volatile struct vdsoproc*)VDSOPROC)->pid;
+
+  return pid ? pid : sysgetpid();
+}
+
 char*
 strcpy(char *s, const char *t)
 {
@@ -145,3 +188,104 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// A mutex costs no system call unless it is contended:
+// a locker that finds it held sets state to 2 and sleeps,
+// and an unlocker that finds 2 wakes one sleeper.
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  while(c != 0){
+    futex_wait(&m->state, 2, 0);
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+    futex_wake(&m->state, 1);
+  }
+}
+
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+// Callers must recheck their condition on return,
+// as with any condition variable.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+
+  mutex_unlock(m);
+  // returns at once if a signal came after the unlock.
+  futex_wait(&c->seq, seq, 0);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 0x7fffffff);
+}
+
+// Queue an operation on a ring_setup() ring. The caller must
+// leave room: at most NRINGENT operations may be submitted
+// and not yet reaped. ring_enter() hands them to the kernel.
+void
+ring_submit(struct ringpage *r, int op, int fd, void *addr, int len, uint64 data)
+{
+  struct ringsqe *e = &r->sq[r->sqtail % NRINGENT];
+
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint64)addr;
+  e->len = len;
+  e->data = data;
+  // the kernel may take the entry as soon as sqtail covers it.
+  __sync_synchronize();
+  r->sqtail++;
+}
+
+// Take the oldest completion off a ring, storing its data in
+// *data, and return its result. ring_enter() must have said
+// that there is one.
+int
+ring_reap(struct ringpage *r, uint64 *data)
+{
+  struct ringcqe *c = &r->cq[r->cqhead % NRINGENT];
+  int res;
+
+  __sync_synchronize();
+  *data = c->data;
+  res = c->res;
+  __sync_synchronize();
+  r->cqhead++;
+  return res;
+}
@@ -1,4 +1,18 @@
 struct stat;
+struct spawnaction;
+struct ringpage;
+struct sysstat;
+struct lockstat;
+struct bstat;
+
+// ulib.c locks, which block in futex_wait() when contended.
+struct mutex {
+  int state;    // 0: free, 1: held, 2: held, maybe with waiters
+};
+
+struct cond {
+  int seq;      // changed by every signal
+};
 
 // system calls
 int fork(void);
@@ -18,10 +32,10 @@ int link(const char*, const char*);
 int mkdir(const char*);
 int chdir(const char*);
 int dup(int);
-int getpid(void);
+int sysgetpid(void);
 char* sbrk(int);
 int sleep(int);
-int uptime(void);
+int sysuptime(void);
 // int getyear(void);  // this is for testing purposes only, can be removed
 int strace(int);
 int settickets(int);
@@ -34,8 +48,31 @@ int sigreturn(void);
 ///////// IMPLEMENTED FOR SCHED TEST //////////////////////
 int waitx(int*, int* /*wtime*/, int* /*rtime*/);
 ////////////////////////////////////////////////////////////
+int shmget(int, int);
+void* shmat(int);
+int shmdt(void*);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int fsync(int);
+int clone(void(*)(void*), void*, void*);
+int join(void**);
+int futex_wait(int*, int, int);
+int futex_wake(int*, int);
+int spawn(const char*, char**, struct spawnaction*);
+struct ringpage* ring_setup(int);
+int ring_enter(int, int);
+int sysstat(struct sysstat*, int);
+int evtrace(int);
+int profile(int);
+int lockstat(struct lockstat*, int);
+int lockbench(int);
+int bstat(struct bstat*);
+int bdrop(void);
 
 // ulib.c
+int getpid(void);
+int uptime(void);
+uint64 uptimens(void);
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
 void *memmove(void*, const void*, int);
@@ -51,3 +88,12 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+void ring_submit(struct ringpage*, int, int, void*, int, uint64);
+int ring_reap(struct ringpage*, uint64*);
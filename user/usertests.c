@@ -2,8 +2,16 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
+#include "user/uthread.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/ring.h"
+#include "kernel/sysstat.h"
+#include "kernel/trace.h"
+#include "kernel/event.h"
+#include "kernel/prof.h"
+#include "kernel/lockstat.h"
+#include "kernel/bstat.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -1954,12 +1962,12 @@ iref(char *s)
 }
 
 // test that fork fails gracefully
-// the forktest binary also does this, but it runs out of proc entries first.
-// inside the bigger usertests binary, we run out of memory first.
+// the forktest binary also does this, with less memory per child.
+// the proc table grows until memory runs out, or it holds NPROC.
 void
 forktest(char *s)
 {
-  enum{ N = 1000 };
+  enum{ N = NPROC };
   int n, pid;
 
   for(n=0; n<N; n++){
@@ -1976,7 +1984,7 @@ forktest(char *s)
   }
 
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work NPROC times!\n", s);
     exit(1);
   }
 
@@ -2571,6 +2579,1312 @@ badarg(char *s)
   exit(0);
 }
 
+// do shared-memory segments share pages between processes,
+// carry over into fork() children, and go away with the
+// last detach, or with their creator if never attached?
+void
+shmtest(char *s)
+{
+  int id, pid, xstatus;
+  char *a, *b;
+
+  id = shmget(0, 3*4096);
+  if(id < 0){
+    printf("%s: shmget failed\n", s);
+    exit(1);
+  }
+  a = shmat(id);
+  if(a == (char*)-1){
+    printf("%s: shmat failed\n", s);
+    exit(1);
+  }
+  if(a[0] != 0 || a[3*4096-1] != 0){
+    printf("%s: segment not zeroed\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    a[0] = 'c';
+    a[2*4096+1] = 'd';
+    // a second attachment shows the same pages.
+    b = shmat(id);
+    if(b == (char*)-1 || b == a || b[0] != 'c')
+      exit(1);
+    b[4096] = 'e';
+    shmdt(b);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child failed\n", s);
+    exit(1);
+  }
+  if(a[0] != 'c' || a[2*4096+1] != 'd' || a[4096] != 'e'){
+    printf("%s: child's writes not seen\n", s);
+    exit(1);
+  }
+  if(shmdt(a) < 0 || shmdt(a) == 0){
+    printf("%s: shmdt wrong\n", s);
+    exit(1);
+  }
+  if(shmat(id) != (char*)-1){
+    printf("%s: segment not freed\n", s);
+    exit(1);
+  }
+
+  // a key names the same segment.
+  id = shmget(77, 4096);
+  if(id < 0 || shmget(77, 100) != id || shmget(77, 2*4096) != -1){
+    printf("%s: shmget with key wrong\n", s);
+    exit(1);
+  }
+  a = shmat(id);
+  if(a == (char*)-1 || shmdt(a) < 0){
+    printf("%s: shmat with key failed\n", s);
+    exit(1);
+  }
+
+  // a segment never attached goes away with its creator:
+  // more of them than there are segments must not use up all.
+  for(int i = 0; i < 20; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0)
+      exit(shmget(0, 4096) < 0);
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: unattached segments not freed\n", s);
+      exit(1);
+    }
+  }
+}
+
+// the byte at off in "mmapfile", by read().
+int
+mmapfilebyte(int off)
+{
+  int fd, i;
+  char c = 0;
+
+  fd = open("mmapfile", O_RDONLY);
+  for(i = 0; i <= off; i++){
+    if(read(fd, &c, 1) != 1)
+      break;
+  }
+  close(fd);
+  return c;
+}
+
+// mmap() of a file: private copies, shared pages that
+// read() sees and that reach the file, fork(), munmap()
+// of part of a mapping, and faults past the end of the file.
+void
+mmaptest(char *s)
+{
+  int fd, i, pid, xstatus;
+  int len = 2*PGSIZE + PGSIZE/2;
+  char *a, *b;
+  char c;
+
+  fd = open("mmapfile", O_CREATE|O_RDWR|O_TRUNC);
+  for(i = 0; i < len; i++){
+    c = 'a' + i % 23;
+    write(fd, &c, 1);
+  }
+
+  // private: the file's data, zeros past its end,
+  // and stores that stay in the process.
+  a = mmap(0, 3*PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(a == (char*)-1){
+    printf("%s: mmap private failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < len; i++){
+    if(a[i] != 'a' + i % 23){
+      printf("%s: mmap private wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+  if(a[len] != 0 || a[3*PGSIZE-1] != 0){
+    printf("%s: mmap past end of file not zero\n", s);
+    exit(1);
+  }
+  a[0] = 'X';
+  if(munmap(a, 3*PGSIZE) < 0){
+    printf("%s: munmap private failed\n", s);
+    exit(1);
+  }
+  if(mmapfilebyte(0) != 'a'){
+    printf("%s: private store reached the file\n", s);
+    exit(1);
+  }
+
+  // shared: read() sees stores at once, a child's too.
+  a = mmap(0, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(a == (char*)-1){
+    printf("%s: mmap shared failed\n", s);
+    exit(1);
+  }
+  a[1] = 'Y';
+  if(mmapfilebyte(1) != 'Y'){
+    printf("%s: read() does not see shared store\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid == 0){
+    a[PGSIZE] = 'Z';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || a[PGSIZE] != 'Z'){
+    printf("%s: child's shared store lost\n", s);
+    exit(1);
+  }
+
+  // past the last page of the file.
+  b = mmap(0, 4*PGSIZE, PROT_READ, MAP_SHARED, fd, 0);
+  pid = fork();
+  if(pid == 0){
+    c = b[3*PGSIZE];
+    printf("%s: read past end of file: %d\n", s, c);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: fault past end of file not killed\n", s);
+    exit(1);
+  }
+
+  // unmap the first page, then the rest.
+  a[2*PGSIZE] = 'W';
+  if(munmap(a + PGSIZE, PGSIZE) == 0 || munmap(a, PGSIZE) < 0 ||
+     munmap(a + PGSIZE, len - PGSIZE) < 0 || munmap(b, 4*PGSIZE) < 0){
+    printf("%s: munmap shared wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // the stores are in the file, through the log.
+  if(mmapfilebyte(1) != 'Y' || mmapfilebyte(PGSIZE) != 'Z' ||
+     mmapfilebyte(2*PGSIZE) != 'W' || mmapfilebyte(len-1) != 'a' + (len-1) % 23){
+    printf("%s: shared stores not written back\n", s);
+    exit(1);
+  }
+  unlink("mmapfile");
+}
+
+#define NCLONE 4
+volatile int clonecount;
+volatile int clonefd = -1;
+
+void
+clonethread(void *arg)
+{
+  int i;
+
+  for(i = 0; i < 1000; i++)
+    __sync_fetch_and_add(&clonecount, 1);
+  // the first thread opens a file, for the others to see.
+  if((uint64)arg == 0)
+    clonefd = open("clonefile", O_CREATE|O_RDWR);
+  exit(0);
+}
+
+// do threads made by clone() share memory and open
+// files, and does join() give back their stacks?
+void
+clonetest(char *s)
+{
+  char *stacks[NCLONE], *top[NCLONE];
+  void *stack;
+  int i, j, pid;
+
+  clonecount = 0;
+  for(i = 0; i < NCLONE; i++){
+    stacks[i] = malloc(4096);
+    top[i] = (char*)(((uint64)stacks[i] + 4096) & ~15L);
+    if(clone(clonethread, (void*)(uint64)i, top[i]) < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+  }
+  if(wait(0) != -1){
+    printf("%s: wait() reaped a thread\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCLONE; i++){
+    if((pid = join(&stack)) < 0){
+      printf("%s: join failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < NCLONE; j++)
+      if(stack == top[j])
+        break;
+    if(j == NCLONE){
+      printf("%s: join returned a bad stack\n", s);
+      exit(1);
+    }
+    free(stacks[j]);
+    top[j] = 0;
+  }
+  if(join(&stack) != -1){
+    printf("%s: join with no threads\n", s);
+    exit(1);
+  }
+  if(clonecount != NCLONE*1000){
+    printf("%s: count %d, not %d\n", s, clonecount, NCLONE*1000);
+    exit(1);
+  }
+  if(clonefd < 0 || write(clonefd, "x", 1) != 1 || close(clonefd) < 0){
+    printf("%s: thread's file not shared\n", s);
+    exit(1);
+  }
+  unlink("clonefile");
+  if(clone(clonethread, 0, (char*)top + 1) != -1){
+    printf("%s: clone with unaligned stack\n", s);
+    exit(1);
+  }
+}
+
+void
+spinthread(void *arg)
+{
+  for(;;)
+    ;
+}
+
+void
+readthread(void *arg)
+{
+  char c;
+
+  read((int)(uint64)arg, &c, 1);
+  exit(0);
+}
+
+// does the exit of a process's main thread take down its
+// other threads, spinning or sleeping? the pipe's write
+// end stays open until the last of them has exited.
+void
+threadexittest(char *s)
+{
+  int fds[2], idle[2], pid, xstatus;
+  char c;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    // readthread sleeps forever: idle[1] is open as well.
+    if(pipe(idle) < 0)
+      exit(1);
+    char *a = malloc(4096), *b = malloc(4096);
+    if(clone(spinthread, 0, (char*)(((uint64)a + 4096) & ~15L)) < 0 ||
+       clone(readthread, (void*)(uint64)idle[0], (char*)(((uint64)b + 4096) & ~15L)) < 0)
+      exit(1);
+    sleep(1);
+    exit(0);
+  }
+  close(fds[1]);
+  if(read(fds[0], &c, 1) != 0){
+    printf("%s: read from pipe\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: clone failed\n", s);
+    exit(1);
+  }
+}
+
+struct mutex futexmu;
+struct cond futexcv;
+volatile int futexcount, futexturn;
+
+void
+futexthread(void *arg)
+{
+  int i, me = (uint64)arg;
+
+  for(i = 0; i < 500; i++){
+    mutex_lock(&futexmu);
+    // take turns, to make the threads block.
+    while(futexturn != me)
+      cond_wait(&futexcv, &futexmu);
+    futexcount++;
+    futexturn = (me + 1) % NCLONE;
+    cond_broadcast(&futexcv);
+    mutex_unlock(&futexmu);
+  }
+  exit(0);
+}
+
+// futex_wait() and futex_wake(), and the ulib
+// mutexes and condition variables built on them.
+void
+futextest(char *s)
+{
+  char *stacks[NCLONE];
+  void *stack;
+  int i, pid, xstatus, id, t0;
+  int word = 1, *w;
+
+  if(futex_wait(&word, 2, 0) != -1){
+    printf("%s: futex_wait on a changed word slept\n", s);
+    exit(1);
+  }
+  t0 = uptime();
+  if(futex_wait(&word, 1, 2) != -1 || uptime() - t0 < 2){
+    printf("%s: futex_wait timeout wrong\n", s);
+    exit(1);
+  }
+  if(futex_wake(&word, 1) != 0 || futex_wait((int*)1, 0, 0) != -1){
+    printf("%s: futex_wake with no waiters wrong\n", s);
+    exit(1);
+  }
+
+  // threads taking turns under a mutex.
+  mutex_init(&futexmu);
+  cond_init(&futexcv);
+  futexcount = futexturn = 0;
+  for(i = 0; i < NCLONE; i++){
+    stacks[i] = malloc(4096);
+    if(clone(futexthread, (void*)(uint64)i,
+             (char*)(((uint64)stacks[i] + 4096) & ~15L)) < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < NCLONE; i++)
+    join(&stack);
+  for(i = 0; i < NCLONE; i++)
+    free(stacks[i]);
+  if(futexcount != NCLONE*500){
+    printf("%s: count %d, not %d\n", s, futexcount, NCLONE*500);
+    exit(1);
+  }
+
+  // a word in shared memory, at different addresses
+  // in two processes.
+  if((id = shmget(0, 4096)) < 0 || (w = shmat(id)) == (int*)-1){
+    printf("%s: shm failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // a second attachment lands elsewhere.
+    if((w = shmat(id)) == (int*)-1)
+      exit(1);
+    while(*w == 0)
+      futex_wait(w, 0, 0);
+    exit(*w == 7 ? 0 : 1);
+  }
+  sleep(2);
+  *w = 7;
+  futex_wake(w, 1);
+  wait(&xstatus);
+  shmdt(w);
+  if(xstatus != 0){
+    printf("%s: child not woken through shared memory\n", s);
+    exit(1);
+  }
+}
+
+struct uchan *uthreadchan;
+int uthreadorder[4], uthreadn, uthreadsum;
+volatile int uthreadflag;
+
+void
+uthreadworker(void *arg)
+{
+  int i;
+
+  for(i = 0; i < 2; i++){
+    uthreadorder[uthreadn++] = (uint64)arg;
+    uthread_yield();
+  }
+  uchan_send(uthreadchan, (uint64)arg * 10);
+}
+
+void
+uthreadreader(void *arg)
+{
+  uthreadsum = uchan_recv(uthreadchan);
+  uthreadsum += uchan_recv(uthreadchan);
+}
+
+// spins without yielding, so only preemption lets the
+// other thread run and set uthreadflag.
+void
+uthreadspinner(void *arg)
+{
+  if((uint64)arg == 0){
+    while(uthreadflag == 0)
+      ;
+  } else {
+    uthreadflag = 1;
+  }
+}
+
+// user-level threads: round-robin yields, a channel
+// that blocks senders and receivers, and preemption
+// by sigalarm().
+void
+uthreadtest(char *s)
+{
+  uthread_init(0);
+  uthreadn = uthreadsum = 0;
+  // one slot: the second sender must wait for the reader.
+  if((uthreadchan = uchan_create(1)) == 0){
+    printf("%s: uchan_create failed\n", s);
+    exit(1);
+  }
+  if(uthread_create(uthreadworker, (void*)1) < 0 ||
+     uthread_create(uthreadworker, (void*)2) < 0 ||
+     uthread_create(uthreadreader, 0) < 0){
+    printf("%s: uthread_create failed\n", s);
+    exit(1);
+  }
+  if(uthread_run() != 0){
+    printf("%s: threads left blocked\n", s);
+    exit(1);
+  }
+  uchan_free(uthreadchan);
+  if(uthreadn != 4 || uthreadorder[0] != 1 || uthreadorder[1] != 2 ||
+     uthreadorder[2] != 1 || uthreadorder[3] != 2){
+    printf("%s: threads did not take turns\n", s);
+    exit(1);
+  }
+  if(uthreadsum != 30){
+    printf("%s: channel passed %d, not 30\n", s, uthreadsum);
+    exit(1);
+  }
+
+  uthread_init(1);
+  uthreadflag = 0;
+  uthread_create(uthreadspinner, 0);
+  uthread_create(uthreadspinner, (void*)1);
+  if(uthread_run() != 0 || uthreadflag != 1){
+    printf("%s: preemption failed\n", s);
+    exit(1);
+  }
+  uthread_init(0);
+}
+
+// spawn() with file actions: the child's output goes
+// to a pipe, and a descriptor it should not see is closed.
+void
+spawntest(char *s)
+{
+  char *echoargv[] = { "echo", "OK", 0 };
+  char buf[8];
+  int fds[2], pid, xstatus, n, i;
+  struct spawnaction acts[] = {
+    { SPAWN_DUP2, 0, 1 }, { SPAWN_CLOSE, 0, 0 }, { SPAWN_CLOSE, 0, 0 }, { 0 },
+  };
+  struct spawnaction bad[] = { { SPAWN_CLOSE, NOFILE-1, 0 }, { 0 } };
+
+  if(spawn("nonexistent", echoargv, 0) != -1 || spawn("echo", echoargv, bad) != -1){
+    printf("%s: bad spawn succeeded\n", s);
+    exit(1);
+  }
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  acts[0].fd = fds[1];
+  acts[1].fd = fds[0];
+  acts[2].fd = fds[1];
+  if((pid = spawn("echo", echoargv, acts)) < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  // echo may write "OK" and "\n" separately.
+  n = 0;
+  while(n < sizeof(buf) && (i = read(fds[0], buf + n, sizeof(buf) - n)) > 0)
+    n += i;
+  close(fds[0]);
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: wait failed\n", s);
+    exit(1);
+  }
+  if(n != 3 || buf[0] != 'O' || buf[1] != 'K' || buf[2] != '\n'){
+    printf("%s: wrong output\n", s);
+    exit(1);
+  }
+}
+
+// more processes than the old fixed table held: kill()
+// finds each by pid, and wait() reaps each exactly once.
+void
+manyprocs(char *s)
+{
+  enum { NCHILD = 150 };
+  int pids[NCHILD], fds[2], i, j, pid, xstatus;
+  char c;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCHILD; i++){
+    pids[i] = fork();
+    if(pids[i] < 0){
+      printf("%s: fork %d failed\n", s, i);
+      exit(1);
+    }
+    if(pids[i] == 0){
+      close(fds[1]);
+      read(fds[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(fds[0]);
+
+  for(i = NCHILD-1; i >= 0; i--){
+    if(kill(pids[i]) < 0){
+      printf("%s: kill %d failed\n", s, pids[i]);
+      exit(1);
+    }
+  }
+  for(i = 0; i < NCHILD; i++){
+    if((pid = wait(&xstatus)) < 0 || xstatus != -1){
+      printf("%s: wait failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < NCHILD && pids[j] != pid; j++)
+      ;
+    if(j == NCHILD){
+      printf("%s: wait returned %d, not a child\n", s, pid);
+      exit(1);
+    }
+    pids[j] = -1;
+    if(kill(pid) != -1){
+      printf("%s: kill of reaped %d succeeded\n", s, pid);
+      exit(1);
+    }
+  }
+  if(wait(0) != -1){
+    printf("%s: wait got too many\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+}
+
+static double
+fpsum(int n)
+{
+  double s = 0;
+  int i;
+
+  for(i = 1; i <= n; i++)
+    s += 1.0 / ((double)i * i);
+  return s;
+}
+
+// floating point in several processes at once: each one's
+// registers must survive the others' use of them, and
+// a fork() child starts with a copy of its parent's.
+void
+fptest(char *s)
+{
+  enum { NCHILD = 4, N = 100000 };
+  double want, x;
+  int i, j, pid, xstatus;
+
+  want = fpsum(N);
+  x = want * 1.5;
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      if(x != want * 1.5)
+        exit(1);
+      for(j = 0; j < 5; j++)
+        if(fpsum(N) != want)
+          exit(1);
+      exit(0);
+    }
+  }
+  // let the children have the harts, and their FP registers.
+  sleep(2);
+  if(x != want * 1.5 || fpsum(N) != want){
+    printf("%s: lost FP state\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCHILD; i++){
+    if(wait(&xstatus) < 0 || xstatus != 0){
+      printf("%s: child computed a wrong result\n", s);
+      exit(1);
+    }
+  }
+}
+
+volatile int vdsopid;
+
+void
+vdsothread(void *arg)
+{
+  vdsopid = getpid();
+  exit(0);
+}
+
+// do uptime() and getpid(), which read the vDSO pages, agree
+// with the system calls, in a child and in threads too? and
+// are the pages read-only?
+void
+vdsotest(char *s)
+{
+  uint64 ns, ns1;
+  int i, pid, tpid, t, xstatus;
+  char *stack;
+  void *st;
+
+  i = uptime();
+  t = sysuptime();
+  if(i > t || uptime() < t){
+    printf("%s: uptime() %d, system call %d\n", s, i, t);
+    exit(1);
+  }
+  ns = uptimens();
+  for(i = 0; i < 1000; i++){
+    if((ns1 = uptimens()) < ns){
+      printf("%s: uptimens() went backwards\n", s);
+      exit(1);
+    }
+    ns = ns1;
+  }
+  // ticks are 1/10th second apart, and can only fall behind.
+  if((uint64)uptime() > ns / 100000000 + 1){
+    printf("%s: uptime() %d ahead of uptimens()\n", s, uptime());
+    exit(1);
+  }
+
+  if(getpid() != sysgetpid()){
+    printf("%s: getpid() %d, system call %d\n", s, getpid(), sysgetpid());
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(getpid() != sysgetpid())
+      exit(1);
+    // with threads, each has its own pid.
+    stack = malloc(4096);
+    tpid = clone(vdsothread, 0, (char*)(((uint64)stack + 4096) & ~15L));
+    if(tpid < 0 || join(&st) != tpid || vdsopid != tpid || getpid() != sysgetpid())
+      exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: wrong pid in child\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    *(volatile uint *)VDSO = 0;
+    printf("%s: wrote the vDSO page\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: vDSO page is writable\n", s);
+    exit(1);
+  }
+}
+
+// does sysstat() count system calls, with histograms
+// that add up?
+void
+sysstattest(char *s)
+{
+  static struct sysstat st0[SYS_sysstat+1], st1[SYS_sysstat+1];
+  uint64 n, n0;
+  int i, b;
+
+  if(sysstat(st0, SYS_sysstat+1) < SYS_sysstat+1){
+    printf("%s: sysstat failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 10; i++)
+    sysgetpid();
+  if(sysstat(st1, SYS_sysstat+1) < SYS_sysstat+1){
+    printf("%s: sysstat failed\n", s);
+    exit(1);
+  }
+  if(strcmp(st1[SYS_getpid].name, "getpid") != 0 ||
+     st1[SYS_getpid].count < st0[SYS_getpid].count + 10 ||
+     st1[SYS_sysstat].count < st0[SYS_sysstat].count + 1){
+    printf("%s: calls not counted\n", s);
+    exit(1);
+  }
+  // other harts' calls may be counted but not yet in the
+  // histogram when a snapshot is taken, or the reverse; but
+  // what one snapshot saw must be in both halves of the next.
+  for(i = 0; i <= SYS_sysstat; i++){
+    for(n = n0 = b = 0; b < NSYSHIST; b++){
+      n0 += st0[i].hist[b];
+      n += st1[i].hist[b];
+    }
+    if(n < st0[i].count || st1[i].count < n0){
+      printf("%s: %s histogram adds up to %d, count %d, before %d and %d\n", s,
+             st1[i].name, (int)n, (int)st1[i].count, (int)n0, (int)st0[i].count);
+      exit(1);
+    }
+  }
+  if(sysstat(st0, -1) != -1 || sysstat((struct sysstat*)0xffffffffff, 1) != -1){
+    printf("%s: sysstat with bad arguments succeeded\n", s);
+    exit(1);
+  }
+}
+
+// does a traced child leave records on the trace device, with
+// its string arguments, and one for its exit()?
+void
+tracetest(char *s)
+{
+  static struct tracerec r[8];
+  int fd, i, n, pid, sawopen = 0, sawexit = 0;
+
+  if((fd = open("trace", O_RDONLY)) < 0){
+    mknod("trace", 2, 0);  // TRACE, in kernel/file.h
+    fd = open("trace", O_RDONLY);
+  }
+  if(fd < 0){
+    printf("%s: cannot open trace device\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    strace((1 << SYS_open) | (1 << SYS_exit));
+    open("tracetest-nonexistent", O_RDONLY);
+    exit(7);
+  }
+  while(!sawexit){
+    if((n = read(fd, r, sizeof(r))) <= 0){
+      printf("%s: read of trace device failed\n", s);
+      exit(1);
+    }
+    for(i = 0; i < n / sizeof(r[0]); i++){
+      if(r[i].pid != pid)
+        continue;
+      if(r[i].num == SYS_open && strcmp(r[i].str[0], "tracetest-nonexistent") == 0 &&
+         r[i].types[0] == 's' && r[i].types[1] == 'i' && (int)r[i].ret == -1)
+        sawopen = 1;
+      if(r[i].num == SYS_exit && r[i].args[0] == 7)
+        sawexit = 1;
+    }
+  }
+  wait(0);
+  close(fd);
+  if(!sawopen){
+    printf("%s: no record of open()\n", s);
+    exit(1);
+  }
+}
+
+// do enabled tracepoints record events, in time order for each
+// CPU, and disabled ones not?
+void
+eventtest(char *s)
+{
+  static struct event ev[64];
+  uint64 last[NCPU];
+  int fd, i, n, pid, traps = 0, kallocs = 0, others = 0;
+  char *a;
+
+  if((fd = open("events", O_RDONLY)) < 0){
+    mknod("events", 3, 0);  // EVENTS, in kernel/file.h
+    fd = open("events", O_RDONLY);
+  }
+  if(fd < 0){
+    printf("%s: cannot open event device\n", s);
+    exit(1);
+  }
+  while(read(fd, ev, sizeof(ev)) > 0)
+    ;
+
+  pid = getpid();
+  evtrace(EVC_TRAP | EVC_KALLOC);
+  for(i = 0; i < 10; i++)
+    sysgetpid();
+  a = sbrk(4096);
+  a[0] = 1;
+  if(evtrace(0) != (EVC_TRAP | EVC_KALLOC)){
+    printf("%s: evtrace() returned the wrong mask\n", s);
+    exit(1);
+  }
+  sbrk(-4096);
+
+  memset(last, 0, sizeof(last));
+  while((n = read(fd, ev, sizeof(ev))) > 0){
+    for(i = 0; i < n / sizeof(ev[0]); i++){
+      if(ev[i].type == EV_LOST)
+        continue;
+      if(ev[i].cpu >= NCPU || ev[i].time < last[ev[i].cpu]){
+        printf("%s: events out of order\n", s);
+        exit(1);
+      }
+      last[ev[i].cpu] = ev[i].time;
+      if(ev[i].type == EV_TRAP && ev[i].pid == pid && ev[i].a == 8)
+        traps++;
+      else if(ev[i].type == EV_KALLOC && ev[i].pid == pid)
+        kallocs++;
+      else if(ev[i].type != EV_TRAP && ev[i].type != EV_KALLOC)
+        others++;
+    }
+  }
+  close(fd);
+  if(traps < 10 || kallocs < 1 || others > 0){
+    printf("%s: %d system call traps, %d kallocs, %d others\n", s,
+           traps, kallocs, others);
+    exit(1);
+  }
+}
+
+// does the profiler catch a process spinning in user space?
+void
+proftest(char *s)
+{
+  static struct profent e[64];
+  int fd, i, n, t, pid, user = 0;
+
+  if((fd = open("profile", O_RDONLY)) < 0){
+    mknod("profile", 4, 0);  // PROFILE, in kernel/file.h
+    fd = open("profile", O_RDONLY);
+  }
+  if(fd < 0){
+    printf("%s: cannot open profile device\n", s);
+    exit(1);
+  }
+  pid = getpid();
+  profile(1);
+  for(t = uptime(); uptime() < t + 4; )
+    ;
+  if(profile(0) != 1){
+    printf("%s: profile() was not on\n", s);
+    exit(1);
+  }
+  while((n = read(fd, e, sizeof(e))) > 0)
+    for(i = 0; i < n / sizeof(e[0]); i++)
+      if(e[i].pid == pid && e[i].pc != 0 && e[i].pc < KERNBASE)
+        user += e[i].count;
+  close(fd);
+  if(user == 0){
+    printf("%s: no samples in user space\n", s);
+    exit(1);
+  }
+}
+
+// with a LOCKSTAT kernel, are the locks counted?
+void
+lockstattest(char *s)
+{
+  static struct lockstat st0[128], st1[128];
+  int i, n;
+  char *a;
+
+  if((n = lockstat(st0, 128)) < 0)
+    return;   // not a LOCKSTAT kernel
+  a = sbrk(4096);
+  a[0] = 1;
+  sbrk(-4096);
+  if(lockstat(st1, 128) < n){
+    printf("%s: lockstat lost entries\n", s);
+    exit(1);
+  }
+  for(i = 0; i < n && i < 128; i++){
+    if(strcmp(st0[i].name, st1[i].name) != 0 || st1[i].acquires < st0[i].acquires){
+      printf("%s: bad counts for %s\n", s, st1[i].name);
+      exit(1);
+    }
+    if(strcmp(st1[i].name, "kmem") == 0 && st1[i].acquires == st0[i].acquires){
+      printf("%s: kmem not counted\n", s);
+      exit(1);
+    }
+  }
+}
+
+// processes on several harts contend for the kernel's spinlock
+// in lockbench(); each must get it, and none deadlock.
+void
+lockbenchtest(char *s)
+{
+  int i, pid, xstatus;
+
+  if(lockbench(0) != -1){
+    printf("%s: lockbench(0) succeeded\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 4; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0)
+      exit(lockbench(50) > 0 ? 0 : 1);
+  }
+  for(i = 0; i < 4; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: lockbench failed\n", s);
+      exit(1);
+    }
+  }
+}
+
+// pid lookups and inode-table hits take no lock (rcu.c): check
+// they stay right while procs and inodes are freed and reused.
+void
+rcutest(char *s)
+{
+  int i, j, pid, fd, n, xstatus;
+  char name[3];
+
+  for(i = 0; i < 4; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid != 0)
+      continue;
+    name[0] = 'r';
+    name[1] = '0' + i;
+    name[2] = 0;
+    for(j = 0; j < 100; j++){
+      if(i & 1){
+        // a reaped child's pid must not be found.
+        if((pid = fork()) < 0)
+          exit(1);
+        if(pid == 0)
+          exit(0);
+        wait(0);
+        if(kill(pid) != -1)
+          exit(1);
+      } else {
+        if((fd = open(name, O_CREATE|O_RDWR)) < 0 ||
+           write(fd, &j, sizeof(j)) != sizeof(j))
+          exit(1);
+        close(fd);
+        if((fd = open(name, O_RDONLY)) < 0 ||
+           read(fd, &n, sizeof(n)) != sizeof(n) || n != j)
+          exit(1);
+        close(fd);
+        if(unlink(name) < 0)
+          exit(1);
+      }
+    }
+    exit(0);
+  }
+  for(i = 0; i < 4; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: lookup failed\n", s);
+      exit(1);
+    }
+  }
+}
+
+// a block read again while cached is a hit, and reading
+// a file larger than the cache leaves the cache working.
+void
+bstattest(char *s)
+{
+  struct bstat st0, st1;
+  char buf[BSIZE];
+  int fd, i;
+
+  if((fd = open("bstat", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'b', sizeof(buf));
+  for(i = 0; i < 40; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  if(bstat(&st0) < 0){
+    printf("%s: bstat failed\n", s);
+    exit(1);
+  }
+  if((fd = open("bstat", O_RDONLY)) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  while((i = read(fd, buf, sizeof(buf))) > 0)
+    if(buf[0] != 'b' || buf[i-1] != 'b'){
+      printf("%s: wrong data\n", s);
+      exit(1);
+    }
+  close(fd);
+  if(bstat(&st1) < 0){
+    printf("%s: bstat failed\n", s);
+    exit(1);
+  }
+  if(st1.hits <= st0.hits || st1.hits + st1.misses < st0.hits + st0.misses + 40){
+    printf("%s: counts did not grow\n", s);
+    exit(1);
+  }
+  if(st1.nbuf < NBUF || st1.nbuf > st1.maxbuf || st1.ncold + st1.nhot > st1.nbuf){
+    printf("%s: bad buffer counts\n", s);
+    exit(1);
+  }
+  unlink("bstat");
+}
+
+// readi() reads ahead of sequential readers: two readers of
+// one file, one sequential and one not, must both get the
+// right data, and with the file's blocks not cached, reads
+// ahead must be started.
+void
+readaheadtest(char *s)
+{
+  struct bstat st0, st1;
+  char buf[BSIZE];
+  int fd, fd1, fd2, i, j, n;
+
+  if((fd = open("readahead", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 40; i++){
+    memset(buf, 'a' + i % 26, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  // so that the reads below go to the disk.
+  bdrop();
+  if(bstat(&st0) < 0){
+    printf("%s: bstat failed\n", s);
+    exit(1);
+  }
+  fd1 = open("readahead", O_RDONLY);
+  fd2 = open("readahead", O_RDONLY);
+  if(fd1 < 0 || fd2 < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  // fd1 reads 100 bytes at a time; fd2 a block at a time,
+  // so that the two take turns at the inode's offsets.
+  for(i = 0; i < 40 * BSIZE; i += n){
+    if((n = read(fd1, buf, 100)) <= 0){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < n; j++){
+      if(buf[j] != 'a' + ((i + j) / BSIZE) % 26){
+        printf("%s: wrong data at %d\n", s, i + j);
+        exit(1);
+      }
+    }
+    if((i / 100) % 10 == 0 &&
+       read(fd2, buf, BSIZE) == BSIZE && buf[0] != buf[BSIZE-1]){
+      printf("%s: wrong data\n", s);
+      exit(1);
+    }
+  }
+  close(fd1);
+  close(fd2);
+  if(bstat(&st1) < 0){
+    printf("%s: bstat failed\n", s);
+    exit(1);
+  }
+  if(st1.readahead <= st0.readahead){
+    printf("%s: no reads ahead\n", s);
+    exit(1);
+  }
+  unlink("readahead");
+}
+
+// wait for one completion on ring r, and return its result,
+// checking that it is the one for the operation tagged data.
+static int
+ringwait1(char *s, struct ringpage *r, uint64 data)
+{
+  uint64 d;
+  int res;
+
+  if(ring_enter(1, 1) < 1){
+    printf("%s: ring_enter failed\n", s);
+    exit(1);
+  }
+  res = ring_reap(r, &d);
+  if(d != data){
+    printf("%s: completion for %d, not %d\n", s, (int)d, (int)data);
+    exit(1);
+  }
+  return res;
+}
+
+// open, write, fsync and close through a syscall ring, with
+// several writes in flight at once on two workers.
+void
+ringtest(char *s)
+{
+  enum { NW = 8, SZ = 512 };
+  static char wbuf[NW][SZ];
+  struct ringpage *r;
+  char rbuf[SZ], seen[NW];
+  uint64 d;
+  int fd, i, n;
+
+  if((r = ring_setup(2)) == (struct ringpage*)-1){
+    printf("%s: ring_setup failed\n", s);
+    exit(1);
+  }
+  if(ring_setup(1) != (struct ringpage*)-1){
+    printf("%s: second ring_setup succeeded\n", s);
+    exit(1);
+  }
+
+  ring_submit(r, RING_OPEN, 0, "ringfile", O_CREATE|O_RDWR, 100);
+  if((fd = ringwait1(s, r, 100)) < 0){
+    printf("%s: ring open failed\n", s);
+    exit(1);
+  }
+
+  // each write is one chunk, so they land whole, in some order.
+  for(i = 0; i < NW; i++){
+    memset(wbuf[i], 'a' + i, SZ);
+    ring_submit(r, RING_WRITE, fd, wbuf[i], SZ, i);
+  }
+  memset(seen, 0, sizeof(seen));
+  for(n = 0; n < NW; ){
+    if(ring_enter(n == 0, 1) < 1){
+      printf("%s: ring_enter failed\n", s);
+      exit(1);
+    }
+    if(ring_reap(r, &d) != SZ || d >= NW || seen[d]){
+      printf("%s: bad write completion\n", s);
+      exit(1);
+    }
+    seen[d] = 1;
+    n++;
+  }
+
+  ring_submit(r, RING_FSYNC, fd, 0, 0, 101);
+  if(ringwait1(s, r, 101) != 0){
+    printf("%s: ring fsync failed\n", s);
+    exit(1);
+  }
+  ring_submit(r, RING_CLOSE, fd, 0, 0, 102);
+  if(ringwait1(s, r, 102) != 0 || close(fd) != -1){
+    printf("%s: ring close failed\n", s);
+    exit(1);
+  }
+  ring_submit(r, RING_READ, fd, rbuf, SZ, 103);
+  if(ringwait1(s, r, 103) != -1){
+    printf("%s: ring read of a closed fd succeeded\n", s);
+    exit(1);
+  }
+
+  if((fd = open("ringfile", O_RDONLY)) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  memset(seen, 0, sizeof(seen));
+  for(i = 0; i < NW; i++){
+    if(read(fd, rbuf, SZ) != SZ || rbuf[0] < 'a' || rbuf[0] >= 'a' + NW ||
+       seen[rbuf[0] - 'a'] || rbuf[SZ-1] != rbuf[0]){
+      printf("%s: wrong file contents\n", s);
+      exit(1);
+    }
+    seen[rbuf[0] - 'a'] = 1;
+  }
+  close(fd);
+  unlink("ringfile");
+}
+
+// does exit() stop ring workers that are blocked reading
+// a pipe, and close the process's files? the parent sees
+// the end of its pipe only once the last of them has gone.
+void
+ringexittest(char *s)
+{
+  struct ringpage *r;
+  int fds[2], idle[2], pid, xstatus;
+  char c, buf[1];
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    if(pipe(idle) < 0 || (r = ring_setup(1)) == (struct ringpage*)-1)
+      exit(1);
+    // nothing is ever written to idle[1].
+    ring_submit(r, RING_READ, idle[0], buf, 1, 0);
+    if(ring_enter(1, 0) < 0)
+      exit(1);
+    sleep(1);
+    exit(0);
+  }
+  close(fds[1]);
+  if(read(fds[0], &c, 1) != 0){
+    printf("%s: read from pipe\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: ring setup failed\n", s);
+    exit(1);
+  }
+}
+
 struct test {
   void (*f)(char *);
   char *s;
@@ -2635,6 +3949,27 @@ struct test {
   {sbrklast, "sbrklast"},
   {sbrk8000, "sbrk8000"},
   {badarg, "badarg" },
+  {shmtest, "shmtest" },
+  {mmaptest, "mmaptest" },
+  {clonetest, "clonetest" },
+  {threadexittest, "threadexittest" },
+  {futextest, "futextest" },
+  {uthreadtest, "uthreadtest" },
+  {spawntest, "spawntest" },
+  {manyprocs, "manyprocs" },
+  {fptest, "fptest" },
+  {ringtest, "ringtest" },
+  {ringexittest, "ringexittest" },
+  {vdsotest, "vdsotest" },
+  {sysstattest, "sysstattest" },
+  {tracetest, "tracetest" },
+  {eventtest, "eventtest" },
+  {proftest, "proftest" },
+  {lockstattest, "lockstattest" },
+  {lockbenchtest, "lockbenchtest" },
+  {rcutest, "rcutest" },
+  {bstattest, "bstattest" },
+  {readaheadtest, "readaheadtest" },
 
   { 0, 0},
 };
@@ -2924,6 +4259,44 @@ outofinodes(char *s)
   }
 }
 
+// can a process use more memory than the machine has,
+// and find what it wrote in the pages that were swapped out?
+void
+swapmuch(char *s)
+{
+  int pid, xstatus;
+  uint64 a, top, va;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // allocate all of memory and swap,
+    // stamping each page with its address.
+    a = (uint64) sbrk(0);
+    for(top = a; ; top += 4096){
+      if(sbrk(4096) == (char*)0xffffffffffffffffL)
+        break;
+      *(uint64*)top = top;
+    }
+    if(top - a <= 128*1024*1024){
+      printf("%s: only %d pages, swap not used\n", s, (int)((top - a) / 4096));
+      exit(1);
+    }
+    for(va = a; va < top; va += 4096){
+      if(*(uint64*)va != va){
+        printf("%s: page %p holds %p\n", s, va, *(uint64*)va);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  exit(xstatus);
+}
+
 struct test slowtests[] = {
   {bigdir, "bigdir"},
   {manywrites, "manywrites"},
@@ -2931,6 +4304,7 @@ struct test slowtests[] = {
   {execout, "execout"},
   {diskfull, "diskfull"},
   {outofinodes, "outofinodes"},
+  {swapmuch, "swapmuch"},
     
   { 0, 0},
 };
@@ -6,10 +6,13 @@ print "# generated by usys.pl - do not edit\n";
 
 print "#include \"kernel/syscall.h\"\n";
 
+# entry("x", "y") names the stub for SYS_x y, for system
+# calls that ulib.c wraps, as it does getpid() and uptime().
 sub entry {
     my $name = shift;
-    print ".global $name\n";
-    print "${name}:\n";
+    my $stub = shift || $name;
+    print ".global $stub\n";
+    print "${stub}:\n";
     print " li a7, SYS_${name}\n";
     print " ecall\n";
     print " ret\n";
@@ -32,10 +35,10 @@ entry("link");
 entry("mkdir");
 entry("chdir");
 entry("dup");
-entry("getpid");
+entry("getpid", "sysgetpid");
 entry("sbrk");
 entry("sleep");
-entry("uptime");
+entry("uptime", "sysuptime");
 # entry("getyear"); # this is for testing purposes only, it can be removed
 entry("strace");
 entry("settickets");
@@ -47,3 +50,23 @@ entry("sigalarm");
 #////////// IMPLEMENTED FOR SCHED TEST ////////////////
 entry("waitx");
 #///////////////////////////////////////////////////////
+entry("shmget");
+entry("shmat");
+entry("shmdt");
+entry("mmap");
+entry("munmap");
+entry("fsync");
+entry("clone");
+entry("join");
+entry("futex_wait");
+entry("futex_wake");
+entry("spawn");
+entry("ring_setup");
+entry("ring_enter");
+entry("sysstat");
+entry("evtrace");
+entry("profile");
+entry("lockstat");
+entry("lockbench");
+entry("bstat");
+entry("bdrop");
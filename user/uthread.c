@@ -0,0 +1,310 @@
+//
+// User-level threads.
+//
+// Threads run one at a time on the process's own kernel thread,
+// switched by uswtch() (uswtch.S), so they cost a stack and a
+// struct uthread each rather than a process. uthread_run() is
+// the scheduler: it runs on the caller's stack and switches to
+// the runnable threads in turn until all have exited.
+//
+// Threads give up the CPU in uthread_yield(), or by blocking in
+// uchan_send() or uchan_recv(). If uthread_init() was given a
+// time slice, the sigalarm() handler uthread_alarm() (uswtch.S)
+// also preempts a thread that has run for that many ticks.
+// The library's own data is then guarded by nopreempt; code in
+// the threads that is not safe to interrupt, such as malloc()
+// and free(), must be bracketed by uthread_nopreempt(1) and
+// uthread_nopreempt(0).
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+#define STACKSIZE 4096
+
+// callee-saved registers, saved by uswtch().
+struct ucontext {
+  uint64 ra;
+  uint64 sp;
+  uint64 s[12];
+  uint64 fs[12];
+  uint64 fcsr;
+};
+
+enum ustate { URUNNABLE, UBLOCKED, UEXITED };
+
+struct uthread {
+  struct ucontext context;
+  enum ustate state;
+  int id;
+  void (*fn)(void*);
+  void *arg;
+  char *stack;
+  struct uthread *next;   // on the run queue or a channel's
+};
+
+struct uqueue {
+  struct uthread *head;
+  struct uthread *tail;
+};
+
+struct uchan {
+  int cap;
+  int n;                  // values in buf
+  int first;              // index of the oldest
+  uint64 *buf;
+  struct uqueue senders;  // blocked because buf is full
+  struct uqueue receivers; // blocked because buf is empty
+};
+
+void uswtch(struct ucontext*, struct ucontext*);
+void uthread_alarm(void);
+
+static struct uqueue runq;
+static struct ucontext schedcontext;
+static struct uthread *current;   // 0 in the scheduler
+static int nextid = 1;
+static int nthreads;              // created and not yet exited
+static int slice;                 // ticks per time slice; 0 if cooperative
+static volatile int nopreempt;
+
+static void
+enqueue(struct uqueue *q, struct uthread *t)
+{
+  t->next = 0;
+  if(q->tail)
+    q->tail->next = t;
+  else
+    q->head = t;
+  q->tail = t;
+}
+
+static struct uthread*
+dequeue(struct uqueue *q)
+{
+  struct uthread *t = q->head;
+
+  if(t){
+    q->head = t->next;
+    if(q->head == 0)
+      q->tail = 0;
+  }
+  return t;
+}
+
+// Switch from the current thread to the scheduler, having put
+// the thread on a queue or changed its state.
+// Called with nopreempt set; it is still set on return.
+static void
+sched(void)
+{
+  uswtch(&current->context, &schedcontext);
+}
+
+void
+uthread_nopreempt(int on)
+{
+  nopreempt += on ? 1 : -1;
+}
+
+// Set the time slice, in ticks, for preemptive mode,
+// or 0 for threads that run until they yield or block.
+// Takes effect at the next uthread_run().
+void
+uthread_init(int ticks)
+{
+  slice = ticks;
+}
+
+// Every thread starts here.
+static void
+uthread_start(void)
+{
+  nopreempt--;
+  current->fn(current->arg);
+  uthread_exit();
+}
+
+// Create a thread that runs fn(arg).
+// Returns its id, or -1 if out of memory.
+int
+uthread_create(void (*fn)(void*), void *arg)
+{
+  struct uthread *t;
+  int id = -1;
+
+  nopreempt++;
+  if((t = malloc(sizeof(*t))) == 0)
+    goto out;
+  if((t->stack = malloc(STACKSIZE)) == 0){
+    free(t);
+    goto out;
+  }
+  memset(&t->context, 0, sizeof(t->context));
+  t->context.ra = (uint64)uthread_start;
+  t->context.sp = ((uint64)t->stack + STACKSIZE) & ~15L;
+  t->fn = fn;
+  t->arg = arg;
+  t->state = URUNNABLE;
+  id = t->id = nextid++;
+  nthreads++;
+  enqueue(&runq, t);
+out:
+  nopreempt--;
+  return id;
+}
+
+int
+uthread_self(void)
+{
+  return current ? current->id : 0;
+}
+
+// Let the other runnable threads run.
+void
+uthread_yield(void)
+{
+  if(current == 0)
+    return;
+  nopreempt++;
+  enqueue(&runq, current);
+  sched();
+  nopreempt--;
+}
+
+void
+uthread_exit(void)
+{
+  nopreempt++;
+  current->state = UEXITED;
+  sched();
+  // not reached: the scheduler frees the thread.
+  exit(1);
+}
+
+// Called by uthread_alarm() when a time slice is up,
+// with the interrupted thread's registers saved.
+void
+uthread_preempt(void)
+{
+  if(current == 0 || nopreempt){
+    // in the scheduler or the library; carry on as
+    // if the alarm had not gone off.
+    sigreturn();
+  }
+  nopreempt++;
+  // this alarm never sigreturn()s, so rearm by hand.
+  sigalarm(slice, uthread_alarm);
+  enqueue(&runq, current);
+  sched();
+  nopreempt--;
+}
+
+// Run threads until they have all exited, or all that are
+// left are blocked on channels. Returns the number left.
+int
+uthread_run(void)
+{
+  struct uthread *t;
+
+  nopreempt++;
+  if(slice > 0)
+    sigalarm(slice, uthread_alarm);
+  while((t = dequeue(&runq)) != 0){
+    current = t;
+    uswtch(&schedcontext, &t->context);
+    current = 0;
+    if(t->state == UEXITED){
+      // t no longer runs on its stack.
+      nthreads--;
+      free(t->stack);
+      free(t);
+    }
+  }
+  if(slice > 0)
+    sigalarm(0, 0);
+  nopreempt--;
+  return nthreads;
+}
+
+// Make a channel that holds up to cap values
+// before a sender has to wait. Returns 0 if out of memory.
+struct uchan*
+uchan_create(int cap)
+{
+  struct uchan *c;
+
+  if(cap < 1)
+    cap = 1;
+  nopreempt++;
+  if((c = malloc(sizeof(*c))) != 0){
+    memset(c, 0, sizeof(*c));
+    c->cap = cap;
+    if((c->buf = malloc(cap * sizeof(uint64))) == 0){
+      free(c);
+      c = 0;
+    }
+  }
+  nopreempt--;
+  return c;
+}
+
+// Free a channel that no thread is blocked on.
+void
+uchan_free(struct uchan *c)
+{
+  nopreempt++;
+  free(c->buf);
+  free(c);
+  nopreempt--;
+}
+
+// Wait on q until woken by wake().
+static void
+block(struct uqueue *q)
+{
+  current->state = UBLOCKED;
+  enqueue(q, current);
+  sched();
+}
+
+static void
+wake(struct uqueue *q)
+{
+  struct uthread *t;
+
+  if((t = dequeue(q)) != 0){
+    t->state = URUNNABLE;
+    enqueue(&runq, t);
+  }
+}
+
+// Send v on c, waiting while c is full.
+void
+uchan_send(struct uchan *c, uint64 v)
+{
+  nopreempt++;
+  while(c->n == c->cap)
+    block(&c->senders);
+  c->buf[(c->first + c->n++) % c->cap] = v;
+  wake(&c->receivers);
+  nopreempt--;
+}
+
+// Receive the oldest value on c, waiting while c is empty.
+uint64
+uchan_recv(struct uchan *c)
+{
+  uint64 v;
+
+  nopreempt++;
+  while(c->n == 0)
+    block(&c->receivers);
+  v = c->buf[c->first];
+  c->first = (c->first + 1) % c->cap;
+  c->n--;
+  wake(&c->senders);
+  nopreempt--;
+  return v;
+}
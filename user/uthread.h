@@ -0,0 +1,18 @@
+// User-level threads, switched by uthread.c within one
+// process, and channels for passing values between them.
+// Link with uthread.o and uswtch.o.
+
+struct uchan;
+
+void uthread_init(int);
+int uthread_create(void (*)(void*), void*);
+void uthread_yield(void);
+void uthread_exit(void) __attribute__((noreturn));
+int uthread_self(void);
+int uthread_run(void);
+void uthread_nopreempt(int);
+
+struct uchan* uchan_create(int);
+void uchan_free(struct uchan*);
+void uchan_send(struct uchan*, uint64);
+uint64 uchan_recv(struct uchan*);
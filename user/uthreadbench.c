@@ -0,0 +1,108 @@
+// Time user-level threads (uthread.c): creating and running
+// many of them, switching between them, passing values over
+// a channel, and the same exchange between two processes
+// over a pipe for comparison.
+//
+// usage: uthreadbench [threads] [messages]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+#define YIELDS 10
+
+struct uchan *ping, *pong;
+int nmsgs;
+
+void
+yielder(void *arg)
+{
+  int i;
+
+  for(i = 0; i < YIELDS; i++)
+    uthread_yield();
+}
+
+void
+pinger(void *arg)
+{
+  int i;
+
+  for(i = 0; i < nmsgs; i++){
+    uchan_send(ping, i);
+    uchan_recv(pong);
+  }
+}
+
+void
+ponger(void *arg)
+{
+  int i;
+
+  for(i = 0; i < nmsgs; i++)
+    uchan_send(pong, uchan_recv(ping));
+}
+
+// the same round trips between two processes.
+int
+pipebench(void)
+{
+  int p1[2], p2[2], i, start;
+  char c = 0;
+
+  if(pipe(p1) < 0 || pipe(p2) < 0){
+    printf("uthreadbench: pipe failed\n");
+    exit(1);
+  }
+  start = uptime();
+  if(fork() == 0){
+    for(i = 0; i < nmsgs; i++){
+      read(p1[0], &c, 1);
+      write(p2[1], &c, 1);
+    }
+    exit(0);
+  }
+  for(i = 0; i < nmsgs; i++){
+    write(p1[1], &c, 1);
+    read(p2[0], &c, 1);
+  }
+  wait(0);
+  close(p1[0]);
+  close(p1[1]);
+  close(p2[0]);
+  close(p2[1]);
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n = 1000, start;
+
+  nmsgs = 10000;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2)
+    nmsgs = atoi(argv[2]);
+
+  start = uptime();
+  for(i = 0; i < n; i++){
+    if(uthread_create(yielder, 0) < 0){
+      printf("uthreadbench: out of memory at %d threads\n", i);
+      exit(1);
+    }
+  }
+  uthread_run();
+  printf("%d threads, %d yields each: %d ticks\n", n, YIELDS, uptime() - start);
+
+  ping = uchan_create(1);
+  pong = uchan_create(1);
+  start = uptime();
+  uthread_create(pinger, 0);
+  uthread_create(ponger, 0);
+  uthread_run();
+  printf("channel %d round trips: %d ticks\n", nmsgs, uptime() - start);
+  printf("pipe    %d round trips: %d ticks\n", nmsgs, pipebench());
+  exit(0);
+}
@@ -0,0 +1,55 @@
+// Time uptime() and getpid(), which read the vDSO pages,
+// against the system calls they replace. Prints the
+// nanoseconds per call, from uptimens().
+//
+// usage: vdsobench [calls]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+static void
+report(char *what, int n, uint64 start)
+{
+  printf("%s: %d ns per call\n", what, (int)((uptimens() - start) / n));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n = 100000;
+  volatile int sink = 0;
+  uint64 start;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1)
+    n = 1;
+
+  start = uptimens();
+  for(i = 0; i < n; i++)
+    sink += uptime();
+  report("uptime()", n, start);
+
+  start = uptimens();
+  for(i = 0; i < n; i++)
+    sink += sysuptime();
+  report("uptime system call", n, start);
+
+  start = uptimens();
+  for(i = 0; i < n; i++)
+    sink += getpid();
+  report("getpid()", n, start);
+
+  start = uptimens();
+  for(i = 0; i < n; i++)
+    sink += sysgetpid();
+  report("getpid system call", n, start);
+
+  start = uptimens();
+  for(i = 0; i < n; i++)
+    sink += uptimens();
+  report("uptimens()", n, start);
+
+  exit(0);
+}